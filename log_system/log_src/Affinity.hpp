@@ -0,0 +1,119 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_AFFINITY_HPP
+#define ASYNCLOG_CLOUDSTORAGE_AFFINITY_HPP
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+namespace mylog::util {
+/**
+ * @brief CPU 绑定和 NUMA 节点查询
+ *
+ * CPU 列表使用和 taskset/内核 cpulist 相同的写法，如 "0-3,8,10-11"，
+ * 空串表示不绑定。NUMA 节点通过 /sys/devices/system/cpu/cpuN/nodeK 查询，
+ * 不依赖 libnuma。
+ */
+class Affinity {
+  public:
+    static std::vector<int> ParseCpuList(const std::string &list) {
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            const std::string item = list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+                continue;
+            const size_t dash = item.find('-');
+            try {
+                const int first = std::stoi(item.substr(0, dash));
+                const int last = dash == std::string::npos
+                                     ? first
+                                     : std::stoi(item.substr(dash + 1));
+                for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+                    cpus.push_back(cpu);
+            } catch (const std::exception &) {
+                std::cout << __FILE__ << __LINE__ << " bad cpu list: " << list
+                          << std::endl;
+            }
+        }
+        return cpus;
+    }
+
+    /**
+     * @brief 把线程绑定到 cpus，cpus 为空时不做任何事
+     */
+    static bool Pin(const pthread_t thread, const std::vector<int> &cpus) {
+        if (cpus.empty())
+            return true;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+            CPU_SET(cpu, &set);
+        const int ret = pthread_setaffinity_np(thread, sizeof(set), &set);
+        if (ret != 0) {
+            std::cout << __FILE__ << __LINE__ << " pthread_setaffinity_np failed: "
+                      << ret << std::endl;
+            return false;
+        }
+        return true;
+    }
+    static bool PinCurrent(const std::vector<int> &cpus) {
+        return Pin(pthread_self(), cpus);
+    }
+
+    /**
+     * @brief 查询 CPU 所在的 NUMA 节点，查不到返回 -1
+     */
+    static int NodeOfCpu(const int cpu) {
+        std::error_code ec;
+        const std::string dir =
+            "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            const std::string name = entry.path().filename().string();
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0) {
+                try {
+                    return std::stoi(name.substr(4));
+                } catch (const std::exception &) {
+                }
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief cpus 都在同一个 NUMA 节点上时返回该节点，否则返回 -1
+     */
+    static int NodeOfCpus(const std::vector<int> &cpus) {
+        int node = -1;
+        for (int cpu : cpus) {
+            const int n = NodeOfCpu(cpu);
+            if (n < 0 || (node >= 0 && n != node))
+                return -1;
+            node = n;
+        }
+        return node;
+    }
+
+    static int NodeCount() {
+        int count = 0;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(
+                 "/sys/devices/system/node", ec)) {
+            const std::string name = entry.path().filename().string();
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                isdigit(static_cast<unsigned char>(name[4])))
+                ++count;
+        }
+        return count;
+    }
+};
+} // namespace mylog::util
+
+#endif // ASYNCLOG_CLOUDSTORAGE_AFFINITY_HPP
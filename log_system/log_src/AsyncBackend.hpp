@@ -0,0 +1,168 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_ASYNCBACKEND_HPP
+#define ASYNCLOG_CLOUDSTORAGE_ASYNCBACKEND_HPP
+#include "Affinity.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mylog {
+/**
+ * @brief 可被共享后端调度的任务，由 AsyncWorker 实现
+ */
+class BackendTask {
+  public:
+    virtual ~BackendTask() = default;
+    /**
+     * @brief 处理一批数据
+     * @return bool 处理完后仍有待处理数据返回 true
+     */
+    virtual bool RunOnce() = 0;
+    /**
+     * @brief 空闲时释放缓冲区内存
+     */
+    virtual void ReleaseIdle() = 0;
+};
+
+/**
+ * @brief 共享刷盘后端
+ *
+ * 少量固定的刷盘线程服务所有注册的日志器：
+ * 1. 日志器有数据时把自己放入就绪队列（已在队列中则不重复放入）
+ * 2. 刷盘线程每次从队首取一个日志器，只处理一批数据
+ * 3. 处理完仍有数据则放回队尾，保证多个日志器之间轮转公平
+ * 4. 刷盘线程空闲时定期让日志器释放空闲缓冲区
+ */
+class AsyncBackend {
+  public:
+    // 与 LogConfig 一样不析构：日志器可能在静态析构阶段才注销
+    static AsyncBackend &GetInstance() {
+        static auto *instance = new AsyncBackend(
+            std::max<size_t>(1, util::LogConfig::GetJsonData()->backend_threads));
+        return *instance;
+    }
+
+    void Register(BackendTask *task) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slots_.emplace(task, Slot{});
+    }
+
+    /**
+     * @brief 注销任务，返回时保证没有刷盘线程在执行该任务
+     */
+    void Unregister(BackendTask *task) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = slots_.find(task);
+        if (it == slots_.end())
+            return;
+        // 之后刷盘线程处理完不再把它放回就绪队列，Schedule 也不再入队
+        it->second.removing = true;
+        cond_done_.wait(lock, [&]() { return !slots_[task].active; });
+        if (slots_[task].queued) {
+            ready_.erase(std::find(ready_.begin(), ready_.end(), task));
+        }
+        slots_.erase(task);
+    }
+
+    /**
+     * @brief 通知后端该任务有数据待处理
+     */
+    void Schedule(BackendTask *task) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = slots_.find(task);
+            if (it == slots_.end())
+                return;
+            Slot &slot = it->second;
+            if (slot.removing)
+                return;
+            if (slot.active) {
+                // 正在被处理，处理完后重新入队
+                slot.rerun = true;
+                return;
+            }
+            if (slot.queued)
+                return;
+            slot.queued = true;
+            ready_.push_back(task);
+        }
+        cond_.notify_one();
+    }
+
+    AsyncBackend(const AsyncBackend &) = delete;
+    AsyncBackend &operator=(const AsyncBackend &) = delete;
+
+  private:
+    struct Slot {
+        bool queued = false; // 是否在就绪队列中
+        bool active = false; // 是否正在被刷盘线程处理
+        bool rerun = false;  // 处理期间又有新数据
+        bool removing = false; // 正在注销，不再入队
+    };
+
+    explicit AsyncBackend(size_t thread_count) {
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads_.emplace_back(&AsyncBackend::ThreadEntry, this);
+        }
+    }
+
+    void ThreadEntry() {
+        util::Affinity::PinCurrent(util::Affinity::ParseCpuList(
+            util::LogConfig::GetJsonData()->worker_cpus));
+        const auto idle = std::chrono::milliseconds(
+            std::max<size_t>(1, util::LogConfig::GetJsonData()->buffer_idle_ms));
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait_for(lock, idle, [&]() { return !ready_.empty(); });
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_sweep_ >= idle) {
+                // 每个空闲周期回收一次各日志器的空闲缓冲区
+                last_sweep_ = now;
+                for (auto &slot : slots_) {
+                    if (!slot.second.queued && !slot.second.active)
+                        slot.first->ReleaseIdle();
+                }
+            }
+            if (ready_.empty())
+                continue;
+            BackendTask *task = ready_.front();
+            ready_.pop_front();
+            Slot *slot = &slots_[task];
+            slot->queued = false;
+            slot->active = true;
+
+            lock.unlock();
+            bool more = task->RunOnce();
+            lock.lock();
+
+            slot = &slots_[task];
+            slot->active = false;
+            if (!slot->removing && (more || slot->rerun)) {
+                slot->rerun = false;
+                slot->queued = true;
+                ready_.push_back(task);
+                cond_.notify_one();
+            }
+            cond_done_.notify_all();
+        }
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cond_;      // 通知刷盘线程有就绪任务
+    std::condition_variable cond_done_; // 通知注销者任务已处理完
+    std::deque<BackendTask *> ready_;   // 就绪队列
+    std::unordered_map<BackendTask *, Slot> slots_;
+    std::vector<std::thread> threads_;
+    std::chrono::steady_clock::time_point last_sweep_ =
+        std::chrono::steady_clock::now();
+};
+} // namespace mylog
+
+#endif // ASYNCLOG_CLOUDSTORAGE_ASYNCBACKEND_HPP
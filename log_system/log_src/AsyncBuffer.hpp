@@ -1,15 +1,18 @@
 #pragma once
+#include "PageRegion.hpp"
 #include "Util.hpp"
 #include <algorithm>
 #include <cassert>
-#include <vector>
 
 namespace mylog {
 class Buffer {
   public:
-    Buffer() : write_pos_(0), read_pos_(0) {
-        buffer_.resize(util::LogConfig::GetJsonData()->buffer_size);
-    }
+    // 构造时只记录逻辑容量，第一次写入时才映射内存，物理页随写入逐页提交
+    Buffer()
+        : buffer_(static_cast<HugePageMode>(
+              util::LogConfig::GetJsonData()->buffer_hugepage)),
+          capacity_(util::LogConfig::GetJsonData()->buffer_size),
+          write_pos_(0), read_pos_(0) {}
 
     /**
      * @brief 向缓冲区写入数据
@@ -18,10 +21,34 @@ class Buffer {
      */
     void Push(const char *data, const size_t len) {
         ToBeEnough(len);
-        std::copy(data, data + len, buffer_.data() + write_pos_);
+        if (buffer_.Size() < capacity_) {
+            buffer_.Resize(capacity_);
+        }
+        std::copy(data, data + len, buffer_.Data() + write_pos_);
         write_pos_ += len;
     }
 
+    /**
+     * @brief 物理页优先分配在 node 上，-1 表示不指定
+     */
+    void SetNumaNode(const int node) { buffer_.SetNumaNode(node); }
+
+    /**
+     * @brief 释放缓冲区占用的物理内存，容量恢复为配置的基础容量
+     * @note 只在缓冲区为空时生效；突发扩容的部分解除映射，其余部分
+     *       madvise 归还物理页，下一次 Push 时按需重新缺页
+     */
+    void Release() {
+        if (!IsEmpty())
+            return;
+        capacity_ = util::LogConfig::GetJsonData()->buffer_size;
+        if (buffer_.Size() > capacity_) {
+            buffer_.Resize(capacity_);
+        }
+        buffer_.Discard();
+        Reset();
+    }
+
     /**
      * @brief 检查缓冲区是否为空
      * @note 当读写位置相等时认为缓冲区为空
@@ -36,7 +63,7 @@ class Buffer {
      */
     char *ReadBegin(const int len) {
         assert(len <= ReadableSize());
-        return &buffer_[read_pos_];
+        return buffer_.Data() + read_pos_;
     }
 
     /**
@@ -45,7 +72,8 @@ class Buffer {
      * @note 通过交换内部数据指针和位置变量实现高效交换
      */
     void Swap(Buffer &buf) {
-        buffer_.swap(buf.buffer_);
+        buffer_.Swap(buf.buffer_);
+        std::swap(capacity_, buf.capacity_);
         std::swap(read_pos_, buf.read_pos_);
         std::swap(write_pos_, buf.write_pos_);
     }
@@ -54,11 +82,13 @@ class Buffer {
      * @brief 获取可读数据的起始位置
      * @return const char* 指向可读数据起始位置的常量指针
      */
-    [[nodiscard]] const char *Begin() const { return &buffer_[read_pos_]; }
+    [[nodiscard]] const char *Begin() const {
+        return buffer_.Data() + read_pos_;
+    }
 
 
     [[nodiscard]] size_t WriteableSize() const { // 写空间剩余容量
-        return buffer_.size() - write_pos_;
+        return capacity_ - write_pos_;
     }
 
     [[nodiscard]] size_t ReadableSize() const { // 读空间剩余容量
@@ -77,21 +107,22 @@ class Buffer {
      * @param len 需要确保存储空间的字节长度
      */
     void ToBeEnough(const size_t len) {
-        const auto buffersize = buffer_.size();
-        if (len >= WriteableSize()) {
+        // 单条数据可能超过一次扩容的大小，循环扩容直到放得下
+        const auto *conf = util::LogConfig::GetJsonData();
+        while (len >= WriteableSize()) {
             // 根据当前缓冲区大小和配置阈值选择不同的扩容策略
-            if (buffer_.size() < util::LogConfig::GetJsonData()->threshold) {
+            if (capacity_ < conf->threshold) {
                 // 当前大小 小于 阈值时，采用指数扩容：容量翻倍
-                buffer_.resize(1 * buffer_.size() + buffersize);
+                capacity_ += std::max(capacity_, len);
             } else {
                 // 当前大小 大于 等于阈值时，采用线性扩容：增加固定大小
-                buffer_.resize(util::LogConfig::GetJsonData()->linear_growth +
-                               buffersize);
+                capacity_ += std::max(conf->linear_growth, len);
             }
         }
     }
 
-    std::vector<char> buffer_; // 缓冲区
+    PageRegion buffer_; // 缓冲区
+    size_t capacity_;   // 逻辑容量，buffer_ 在写入时才扩展到该大小
     size_t write_pos_; // 写位置
     size_t read_pos_; //
 };
@@ -5,24 +5,64 @@
 #include "Level.hpp"
 #include "LogFlush.hpp"
 #include "Message.hpp"
+#include "SinkDispatcher.hpp"
 #include "ThreadPool.hpp"
+#include <atomic>
 #include <cstdarg>
+#include <memory>
 #ifndef ASYNCLOG_CLOUDSTORAGE_ASYNCLOGGER_HPP
 #define ASYNCLOG_CLOUDSTORAGE_ASYNCLOGGER_HPP
 extern ThreadPool *tp; // 若在头文件表示"这个变量存在，但不在这里定义"
 namespace mylog {
-class AsyncLogger {
+class AsyncLogger : public CrashDrainTask {
   public:
     using ptr = std::shared_ptr<AsyncLogger>;
     AsyncLogger(std::string name, std::vector<LogFlush::ptr> flushes,
-                AsyncType type)
+                AsyncType type, bool shared_backend = false,
+                std::vector<int> worker_cpus = {})
         : logger_name_(std::move(name)), flushes_(std::move(flushes)),
+          dispatchers_(CreateDispatchers(flushes_, type)),
           asyncworker(std::make_shared<AsyncWorker>( // 启动异步工作器
               std::bind(&AsyncLogger::RealFlush, this, std::placeholders::_1),
-              type)) {}
+              type, shared_backend ? &AsyncBackend::GetInstance() : nullptr,
+              OpenCrashRing(logger_name_), std::move(worker_cpus))) {
+        asyncworker->SetSyncCallback([this]() { SyncSinks(); });
+        if (!util::LogConfig::GetJsonData()->crash_ring_dir.empty())
+            CrashGuard::Register(this);
+        ScheduleFlushTimer();
+    }
+    ~AsyncLogger() override {
+        CrashGuard::Unregister(this);
+        // 定时刷盘可能正持有工作器发起屏障，先停掉工作器，之后的屏障
+        // 不会再调用已经析构的输出方向
+        asyncworker->Stop();
+    }
+
+    /**
+     * @brief 刷盘屏障：等待调用前写入的日志全部写到各输出方向并落盘
+     * @param timeout 最长等待时间
+     * @return bool 超时返回 false，此时日志仍会在之后照常写出
+     */
+    bool Flush(const std::chrono::milliseconds timeout) {
+        return asyncworker->Flush(std::chrono::steady_clock::now() + timeout);
+    }
+
+    /**
+     * @brief 致命信号处理中调用：把环形日志中未刷盘的记录同步写到各输出方向
+     */
+    void EmergencyDrain() override {
+        asyncworker->EmergencyDrain([&](const char *data, const size_t len) {
+            for (const auto &flush : flushes_) {
+                flush->Flush(data, len);
+            }
+        });
+        fflush(nullptr);
+    }
     [[nodiscard]] std::string Name() const { return logger_name_; }
     void Debug(const std::string &file, size_t line, const std::string format,
                ...) {
+        if (!Enabled(LogLevel::value::DEBUG))
+            return;
         va_list args;
         va_start(args, format);
         char *ret;
@@ -36,6 +76,8 @@ class AsyncLogger {
     }
     void Info(const std::string &file, const size_t line,
               const std::string format, ...) {
+        if (!Enabled(LogLevel::value::INFO))
+            return;
         va_list va;
         va_start(va, format);
         char *ret;
@@ -50,6 +92,8 @@ class AsyncLogger {
     };
     void Warn(const std::string &file, const size_t line,
               const std::string format, ...) {
+        if (!Enabled(LogLevel::value::WARN))
+            return;
         va_list va;
         va_start(va, format);
         char *ret;
@@ -64,6 +108,8 @@ class AsyncLogger {
     };
     void Error(const std::string &file, const size_t line,
                const std::string format, ...) {
+        if (!Enabled(LogLevel::value::ERROR))
+            return;
         va_list va;
         va_start(va, format);
         char *ret;
@@ -78,6 +124,8 @@ class AsyncLogger {
     };
     void Fatal(const std::string &file, const size_t line,
                const std::string format, ...) {
+        if (!Enabled(LogLevel::value::FATAL))
+            return;
         va_list va;
         va_start(va, format);
         char *ret;
@@ -89,41 +137,131 @@ class AsyncLogger {
 
         free(ret);
         ret = nullptr;
+        // FATAL 之后进程通常马上退出，等这条日志落盘再返回
+        const size_t wait_ms = util::LogConfig::GetJsonData()->fatal_flush_ms;
+        if (wait_ms > 0)
+            Flush(std::chrono::milliseconds(wait_ms));
     };
 
+    // 级别过滤在格式化之前，被过滤的日志不产生任何开销
+    static bool Enabled(const LogLevel::value level) {
+        return level >= util::LogConfig::GetJsonData()->log_level;
+    }
+
   protected:
     void serialize(LogLevel::value level, const std::string &file, size_t line,
                    char *log) {
         LogMessage logmessage(level, file, line, log, logger_name_);
         std::string data = logmessage.format();
         if (level == LogLevel::value::ERROR || level == LogLevel::value::FATAL) {
-            try
-            {
-                auto ret = tp->addTask(send_backlog, data);
-                ret.get();
-            }
-            catch (const std::runtime_error &e)
+            // 远程备份走高优先级调度类，不被批量任务拖慢。提交后不等待：
+            // 调用者可能就是线程池的工作线程，阻塞等待会占住工作线程，
+            // 并发的错误日志多了整个线程池都会卡在连接备份服务器上
+            static const ThreadPool::ClassId backup_class =
+                tp->findClass("log_backup");
+            if (!tp->postTo(backup_class, [data]() { send_backlog(data); }))
             {
-                // 该线程池没有把stop设置为true的逻辑，所以不做处理
-                std::cout << __FILE__ << __LINE__ << "thread pool closed" << std::endl;
+                // 调度类队列满时放弃这次远程备份，本地日志照常写入
+                std::cout << __FILE__ << __LINE__ << " log_backup queue full"
+                          << std::endl;
             }
         }
         Flush(data.c_str(), data.size());
     }
     void Flush(const char *data, size_t len) { asyncworker->Push(data, len); }
+    // 刷盘屏障的同步回调，在消费者线程中调用
+    void SyncSinks() {
+        if (!dispatchers_.empty()) {
+            for (const auto &dispatcher : dispatchers_) {
+                dispatcher->Sync();
+            }
+            return;
+        }
+        for (const auto &flush : flushes_) {
+            flush->Sync();
+        }
+    }
     void RealFlush(Buffer &buffer) {
         if (flushes_.empty()) {
             return;
         }
+        if (!dispatchers_.empty()) {
+            // 多个输出方向并行写：拷贝一份只读批次，所有分发器写完后自动释放
+            auto batch = std::make_shared<const std::string>(
+                buffer.Begin(), buffer.ReadableSize());
+            for (const auto &dispatcher : dispatchers_) {
+                dispatcher->Submit(batch);
+            }
+            return;
+        }
         for (const auto &flush : flushes_) {
             flush->Flush(buffer.Begin(), buffer.ReadableSize());
         }
     }
 
+    /**
+     * @brief flush_log 为 0 时输出方向只在缓存写满时才写出，由线程池每隔
+     *        flush_interval_ms 发起一次不等待的刷盘屏障
+     * @note 屏障的同步回调在消费者线程中执行，输出方向仍然只被一个线程访问；
+     *       每次触发时重新读取 flush_log，热加载后即时生效。日志器析构后由
+     *       定时任务自己取消：日志器可能在线程池销毁之后才析构
+     */
+    void ScheduleFlushTimer() {
+        const size_t interval = util::LogConfig::GetJsonData()->flush_interval_ms;
+        if (tp == nullptr || interval == 0)
+            return;
+        auto id = std::make_shared<std::atomic<ThreadPool::TimerId>>(0);
+        std::weak_ptr<AsyncWorker> worker = asyncworker;
+        id->store(tp->scheduleEvery(
+            std::chrono::milliseconds(interval), [id, worker]() {
+                auto w = worker.lock();
+                if (!w) {
+                    tp->cancelTimer(id->load());
+                    return;
+                }
+                if (util::LogConfig::GetJsonData()->flush_log == 0)
+                    w->Flush(std::chrono::steady_clock::now());
+            }));
+    }
+
+    /**
+     * @brief 配置了 sink_backlog_bytes 且有多个输出方向时为每个方向创建分发线程
+     * @note 启用崩溃保护环形日志时保持串行写，批次写完才能标记环形日志已刷盘；
+     *       ASYNC_SAFE 日志器积压满时等待而不丢弃
+     */
+    static std::vector<SinkDispatcher::ptr>
+    CreateDispatchers(const std::vector<LogFlush::ptr> &flushes,
+                      const AsyncType type) {
+        std::vector<SinkDispatcher::ptr> dispatchers;
+        const auto *conf = util::LogConfig::GetJsonData();
+        const size_t limit = conf->sink_backlog_bytes;
+        if (limit == 0 || flushes.size() < 2 || !conf->crash_ring_dir.empty())
+            return dispatchers;
+        for (const auto &flush : flushes) {
+            dispatchers.emplace_back(
+                std::make_shared<SinkDispatcher>(
+                    flush, limit, type == AsyncType::ASYNC_UNSAFE));
+        }
+        return dispatchers;
+    }
+
+    /**
+     * @brief 配置了 crash_ring_dir 时打开 <crash_ring_dir>/<日志器名>.ring
+     */
+    static ShmRing::ptr OpenCrashRing(const std::string &name) {
+        const auto *conf = util::LogConfig::GetJsonData();
+        if (conf->crash_ring_dir.empty())
+            return nullptr;
+        return ShmRing::Open(conf->crash_ring_dir + "/" + name + ".ring",
+                             conf->crash_ring_bytes);
+    }
+
   protected:
     std::string logger_name_;
     std::vector<LogFlush::ptr> flushes_; // 输出到指定方向\
     // std::vector<LogFlush> flushes_;不能使用 Logflush 作为元素类型，Logflush 是纯虚类，不能实例化
+    // 分发器声明在 asyncworker 之前：工作线程退出前刷出的最后一批还要交给分发器
+    std::vector<SinkDispatcher::ptr> dispatchers_;
     AsyncWorker::ptr asyncworker;
 };
 
@@ -132,6 +270,12 @@ class LoggerBuilder {
     using ptr = std::shared_ptr<LoggerBuilder>;
     void BuildName(const std::string &name) { logger_name_ = name; }
     void BuildLoggerType(const AsyncType type) { async_type_ = type; }
+    // 使用共享刷盘后端，不再为该日志器单独创建工作线程
+    void BuildSharedBackend(const bool shared) { shared_backend_ = shared; }
+    // 工作线程绑定的 CPU 列表，如 "0-3"，默认取配置项 worker_cpus
+    void BuildWorkerCpus(const std::string &cpus) {
+        worker_cpus_ = util::Affinity::ParseCpuList(cpus);
+    }
 
     template <typename FlushType, typename... Args>
     void BuildLoggerFlush(Args &&...args) {
@@ -144,13 +288,18 @@ class LoggerBuilder {
             flushes_.emplace_back(std::make_shared<StdoutFlush>());
         }
         return std::make_shared<AsyncLogger>(logger_name_, flushes_,
-                                             async_type_);
+                                             async_type_, shared_backend_,
+                                             worker_cpus_);
     }
 
   protected:
     std::string logger_name_{"default"};           // 日志器名称
     std::vector<LogFlush::ptr> flushes_;           // 刷盘方式
     AsyncType async_type_ = AsyncType::ASYNC_SAFE; // 缓冲区增长模式
+    bool shared_backend_ =                         // 配置了共享线程时默认共享
+        util::LogConfig::GetJsonData()->backend_threads > 0;
+    std::vector<int> worker_cpus_ = util::Affinity::ParseCpuList(
+        util::LogConfig::GetJsonData()->worker_cpus); // 工作线程绑定的 CPU
 };
 } // namespace mylog
 
@@ -1,28 +1,102 @@
 
 #ifndef ASYNCLOG_CLOUDSTORAGE_ASYNCWORKER_HPP
 #define ASYNCLOG_CLOUDSTORAGE_ASYNCWORKER_HPP
+#include "Affinity.hpp"
+#include "AsyncBackend.hpp"
 #include "AsyncBuffer.hpp"
+#include "ShmRing.hpp"
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
 #include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace mylog {
 enum class AsyncType { ASYNC_SAFE, ASYNC_UNSAFE };
-class AsyncWorker {
+class AsyncWorker : public BackendTask {
   public:
     using ptr = std::shared_ptr<AsyncWorker>;
+    /**
+     * @param cb 消费一批数据的回调
+     * @param async_type 缓冲区增长模式
+     * @param backend 共享刷盘后端，为空时使用独占的工作线程
+     * @param ring 崩溃保护环形日志，为空时不启用
+     * @param cpus 独占工作线程绑定的 CPU，为空时不绑定；这些 CPU 在同一个
+     *             NUMA 节点上时，两个缓冲区的物理页也优先分配在该节点
+     */
     AsyncWorker(const std::function<void(Buffer &)> &cb,
-                AsyncType async_type = AsyncType::ASYNC_SAFE)
-        : async_type_(async_type), stop_(false),
-          thread_(&AsyncWorker::ThreadEntry, this), callback_(cb) {}
-    ~AsyncWorker() { Stop(); }
+                AsyncType async_type = AsyncType::ASYNC_SAFE,
+                AsyncBackend *backend = nullptr, ShmRing::ptr ring = nullptr,
+                std::vector<int> cpus = {})
+        : async_type_(async_type), stop_(false), backend_(backend),
+          ring_(std::move(ring)), cpus_(std::move(cpus)), callback_(cb),
+          spin_count_(util::LogConfig::GetJsonData()->worker_spin_count),
+          batch_min_bytes_(util::LogConfig::GetJsonData()->batch_min_bytes),
+          batch_max_delay_(util::LogConfig::GetJsonData()->batch_max_delay_us) {
+        // 生产者第一次写入时才缺页，提前设置内存策略让页落在消费者的节点上
+        const int node = util::Affinity::NodeOfCpus(cpus_);
+        buffer_productor_.SetNumaNode(node);
+        buffer_consumer_.SetNumaNode(node);
+        if (ring_)
+            Recover();
+        if (backend_) {
+            backend_->Register(this);
+        } else {
+            thread_ = std::thread(&AsyncWorker::ThreadEntry, this);
+        }
+    }
+    ~AsyncWorker() override { Stop(); }
     void Stop() {
-        stop_ = true;
-        cond_consumer_.notify_all();
-        thread_.join();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stop_)
+                return;
+            stop_ = true;
+        }
+        cond_productor_.notify_all();
+        if (backend_) {
+            // 注销后后端不会再调度本对象，剩余数据在当前线程刷完
+            backend_->Unregister(this);
+            while (RunOnce()) {
+            }
+        } else {
+            cond_consumer_.notify_all();
+            thread_.join();
+        }
+    }
+    /**
+     * @brief 设置刷盘屏障的同步回调，在消费者线程中于屏障之前的数据写完后调用
+     */
+    void SetSyncCallback(std::function<void()> cb) { sync_ = std::move(cb); }
+
+    /**
+     * @brief 刷盘屏障：等待调用前 Push 的数据全部交给回调并执行同步回调
+     * @return bool 在 deadline 之前完成返回 true
+     * @note 不使用屏障时 Push/RunOnce 只多一次整数比较
+     */
+    bool Flush(const std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // 消费者交换缓冲区时记下当前代数，之前写入的数据必然在这一批或更早
+        const uint64_t gen = ++flush_requested_;
+        const bool schedule = !pending_;
+        pending_ = true;
+        consumer_waiting_ = false;
+        lock.unlock();
+        if (backend_) {
+            if (schedule)
+                backend_->Schedule(this);
+        } else {
+            cond_consumer_.notify_one();
+        }
+        lock.lock();
+        return cond_flushed_.wait_until(lock, deadline,
+                                        [&]() { return flush_done_ >= gen; });
     }
+
     void Push(const char *data, const size_t len) {
 
         std::unique_lock<std::mutex> lock(mutex_);
@@ -35,29 +109,182 @@ class AsyncWorker {
                 return;
         }
         // 写入数据
+        const bool was_empty = buffer_productor_.IsEmpty();
         buffer_productor_.Push(data, len);
-        // 通知消费者读取数据
+        if (ring_)
+            ring_->Append(data, len);
+        readable_.store(buffer_productor_.ReadableSize(),
+                        std::memory_order_relaxed);
+        const bool schedule = !pending_;
+        pending_ = true;
+        // 只在消费者睡眠时唤醒：空变非空时唤醒它开始攒批，攒够
+        // batch_min_bytes 时唤醒它交换缓冲区，其余情况不产生 futex 调用
+        const bool wake =
+            consumer_waiting_ &&
+            (was_empty || buffer_productor_.ReadableSize() >= batch_min_bytes_);
+        if (wake)
+            consumer_waiting_ = false;
         lock.unlock();
-        cond_consumer_.notify_one();
+        if (backend_) {
+            // 已经在后端排队的不必重复调度
+            if (schedule)
+                backend_->Schedule(this);
+        } else if (wake) {
+            cond_consumer_.notify_one();
+        }
+    }
+
+    /**
+     * @brief 交换缓冲区并消费一批数据
+     * @return bool 消费完后生产者缓冲区仍有数据返回 true
+     */
+    bool RunOnce() override {
+        uint64_t ring_pos = 0;
+        uint64_t flush_gen;
+        bool has_data, flush;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pending_ = false;
+            flush_gen = flush_requested_;
+            flush = FlushPending();
+            has_data = !buffer_productor_.IsEmpty();
+            if (!has_data && !flush)
+                return false;
+            if (has_data) {
+                buffer_productor_.Swap(buffer_consumer_);
+                readable_.store(0, std::memory_order_relaxed);
+                last_active_ = std::chrono::steady_clock::now();
+                if (ring_)
+                    ring_pos = ring_->WritePos();
+            }
+        }
+        if (has_data) {
+            cond_productor_.notify_all();
+            callback_(buffer_consumer_);
+            buffer_consumer_.Reset();
+        }
+        // 有等待中的屏障：这一批写完后让输出方向落盘再通知等待者
+        if (flush && sync_)
+            sync_();
+        std::unique_lock<std::mutex> lock(mutex_);
+        // 这一批已经写到输出方向，环形日志中对应的记录不再需要恢复
+        if (has_data && ring_)
+            ring_->MarkFlushed(ring_pos);
+        if (flush) {
+            flush_done_ = flush_gen;
+            cond_flushed_.notify_all();
+        }
+        return !buffer_productor_.IsEmpty();
+    }
+
+    /**
+     * @brief 收到致命信号时把环形日志中未刷盘的记录直接交给 fn
+     * @note 不加锁，工作线程可能正在写同一批数据，宁可重复也不丢失
+     */
+    template <typename F> void EmergencyDrain(F &&fn) {
+        if (!ring_)
+            return;
+        const uint64_t write = ring_->WritePos();
+        ring_->ForEachUnflushed(fn);
+        ring_->MarkFlushed(write);
+    }
+
+    /**
+     * @brief 超过配置的空闲时间没有数据时释放两个缓冲区的内存
+     */
+    void ReleaseIdle() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (std::chrono::steady_clock::now() - last_active_ < IdlePeriod())
+            return;
+        buffer_productor_.Release();
+        buffer_consumer_.Release();
     }
 
   private:
+    /**
+     * @brief 启动时把上次进程遗留在环形日志中的记录先交给回调写出
+     */
+    void Recover() {
+        if (ring_->FlushedPos() == ring_->WritePos())
+            return;
+        Buffer recovered;
+        const std::string note =
+            "[mylog] recovered unflushed records from crash ring\n";
+        recovered.Push(note.data(), note.size());
+        ring_->ForEachUnflushed([&](const char *data, const size_t len) {
+            recovered.Push(data, len);
+        });
+        callback_(recovered);
+        ring_->MarkFlushed(ring_->WritePos());
+    }
+
+    static std::chrono::milliseconds IdlePeriod() {
+        return std::chrono::milliseconds(
+            std::max<size_t>(1, util::LogConfig::GetJsonData()->buffer_idle_ms));
+    }
+
+    /**
+     * @brief 睡眠前先自旋等待数据，数据量达到攒批大小或自旋次数用完时返回
+     */
+    void SpinWait() const {
+        const size_t target = std::max<size_t>(1, batch_min_bytes_);
+        for (size_t i = 0; i < spin_count_; ++i) {
+            if (readable_.load(std::memory_order_relaxed) >= target || stop_)
+                return;
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+    }
+
+    // 调用方持有 mutex_
+    bool FlushPending() const { return flush_requested_ != flush_done_; }
+
+    // 配置热加载后更新攒批参数，调用方持有 mutex_
+    void RefreshConfig() {
+        const auto *conf = util::LogConfig::GetJsonData();
+        if (conf == conf_)
+            return;
+        conf_ = conf;
+        spin_count_ = conf->worker_spin_count;
+        batch_min_bytes_ = conf->batch_min_bytes;
+        batch_max_delay_ = std::chrono::microseconds(conf->batch_max_delay_us);
+    }
+
     void ThreadEntry() {
-        while (!stop_) {
+        util::Affinity::PinCurrent(cpus_);
+        while (true) {
+            SpinWait();
             {
                 std::unique_lock<std::mutex> lock(mutex_);
-                cond_consumer_.wait(lock, [&]() {
-                    return !buffer_consumer_.IsEmpty() || stop_;
-                });
-                buffer_productor_.Swap(buffer_consumer_);
-                if (AsyncType::ASYNC_UNSAFE == async_type_) {
-                    cond_productor_.notify_one();
+                RefreshConfig();
+                consumer_waiting_ = true;
+                if (!cond_consumer_.wait_for(lock, IdlePeriod(), [&]() {
+                        return !buffer_productor_.IsEmpty() || stop_ ||
+                               FlushPending();
+                    })) {
+                    // 一个空闲周期内没有数据，释放缓冲区内存
+                    consumer_waiting_ = false;
+                    buffer_productor_.Release();
+                    buffer_consumer_.Release();
+                    continue;
+                }
+                // 攒批：不足 batch_min_bytes 时最多再等 batch_max_delay_us，
+                // 用有限的延迟换更大的批次和更少的写调用
+                if (!stop_ && !FlushPending() &&
+                    buffer_productor_.ReadableSize() < batch_min_bytes_) {
+                    consumer_waiting_ = true;
+                    cond_consumer_.wait_for(lock, batch_max_delay_, [&]() {
+                        return buffer_productor_.ReadableSize() >=
+                                   batch_min_bytes_ ||
+                               stop_ || FlushPending();
+                    });
                 }
+                consumer_waiting_ = false;
+                if (stop_ && buffer_productor_.IsEmpty() && !FlushPending())
+                    return;
             }
-            callback_(buffer_consumer_);
-            buffer_consumer_.Reset();
-            if (stop_ && buffer_productor_.IsEmpty())
-                return;
+            RunOnce();
         }
     }
 
@@ -69,8 +296,24 @@ class AsyncWorker {
     std::mutex mutex_;
     AsyncType async_type_;
     std::atomic<bool> stop_; // 控制异步工作器的启动
+    bool pending_ = false;   // 生产者缓冲区有数据且已通知消费者
+    bool consumer_waiting_ = false;    // 消费者线程正在睡眠等待
+    std::atomic<size_t> readable_{0}; // 生产者缓冲区可读字节数，供自旋检查
+    AsyncBackend *backend_;  // 为空表示使用独占线程 thread_
+    ShmRing::ptr ring_;      // 崩溃保护环形日志，Push 时同步写入一份
+    std::vector<int> cpus_;  // 独占工作线程绑定的 CPU
     std::thread thread_;
     std::function<void(Buffer &)> callback_;
+    std::function<void()> sync_;         // 刷盘屏障的同步回调
+    std::condition_variable cond_flushed_; // 通知屏障等待者
+    uint64_t flush_requested_ = 0; // 已请求的屏障代数，受 mutex_ 保护
+    uint64_t flush_done_ = 0;      // 已完成的屏障代数，受 mutex_ 保护
+    std::chrono::steady_clock::time_point last_active_ =
+        std::chrono::steady_clock::now();
+    const util::LogConfig *conf_ = util::LogConfig::GetJsonData(); // 攒批参数来自的快照
+    size_t spin_count_;     // 睡眠前的自旋次数
+    size_t batch_min_bytes_; // 攒批的最小字节数
+    std::chrono::microseconds batch_max_delay_; // 攒批的最长等待时间
 };
 } // namespace mylog
 
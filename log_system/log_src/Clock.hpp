@@ -0,0 +1,169 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_CLOCK_HPP
+#define ASYNCLOG_CLOUDSTORAGE_CLOCK_HPP
+#include "Util.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace mylog::util {
+/**
+ * @brief 日志时间戳时钟，由配置项 log_clock 选择：
+ *
+ * - "coarse"：CLOCK_REALTIME_COARSE，最便宜，精度为一个时钟节拍(通常 1~4ms)
+ * - "realtime"：CLOCK_REALTIME，纳秒精度，vDSO 调用约 20ns
+ * - "tsc"：直接读 CPU 的不变 TSC 计数器，只要几纳秒；启动时用墙上时钟
+ *   校准频率，之后每秒在换算时重新对齐一次，消除频率误差的累积。
+ *   CPU 不支持不变 TSC 时退回 "realtime"
+ *
+ * 打日志时只用 Now() 取原始计数，换算成墙上时间(ToTimespec)放在格式化时做。
+ */
+class Clock {
+  public:
+    enum class Type { COARSE, REALTIME, TSC };
+
+    static uint64_t Now() {
+        switch (Instance().type_) {
+        case Type::TSC:
+            return ReadTsc();
+        case Type::COARSE:
+            return ReadClock(CLOCK_REALTIME_COARSE);
+        default:
+            return ReadClock(CLOCK_REALTIME);
+        }
+    }
+
+    /**
+     * @brief 把 Now() 返回的原始计数换算成墙上时间
+     */
+    static timespec ToTimespec(const uint64_t ticks) {
+        uint64_t ns = ticks;
+        if (Instance().type_ == Type::TSC)
+            ns = Instance().TscToNs(ticks);
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(ns / 1000000000ULL);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000ULL);
+        return ts;
+    }
+
+  private:
+    static Clock &Instance() {
+        static Clock clock;
+        return clock;
+    }
+
+    Clock() {
+        const std::string &name = LogConfig::GetJsonData()->log_clock;
+        if (name == "coarse") {
+            type_ = Type::COARSE;
+        } else if (name == "tsc" && InvariantTsc()) {
+            type_ = Type::TSC;
+            Calibrate();
+        } else {
+            type_ = Type::REALTIME;
+        }
+    }
+
+    static uint64_t ReadClock(const clockid_t id) {
+        timespec ts{};
+        clock_gettime(id, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+               static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    static uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return ReadClock(CLOCK_REALTIME);
+#endif
+    }
+
+    // CPUID 0x80000007 EDX 第 8 位：TSC 频率恒定且在各 C 状态下不停
+    static bool InvariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+            return false;
+        __cpuid(0x80000007, eax, ebx, ecx, edx);
+        return (edx & (1u << 8)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    // 启动时测量 10ms 内 TSC 与墙上时钟的增量得到初始频率
+    void Calibrate() {
+        const uint64_t tsc0 = ReadTsc();
+        const uint64_t ns0 = ReadClock(CLOCK_REALTIME);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const uint64_t tsc1 = ReadTsc();
+        const uint64_t ns1 = ReadClock(CLOCK_REALTIME);
+        ns_per_tick_.store(static_cast<double>(ns1 - ns0) /
+                               static_cast<double>(tsc1 - tsc0),
+                           std::memory_order_relaxed);
+        base_tsc_.store(tsc1, std::memory_order_relaxed);
+        base_ns_.store(ns1, std::memory_order_relaxed);
+        resync_ticks_ = static_cast<uint64_t>(
+            1e9 / ns_per_tick_.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief TSC 计数换算为纳秒，距上次对齐超过一秒时重新对齐
+     *
+     * 换算参数用序列锁保护：写者把 seq_ 改为奇数后更新参数再改回偶数，
+     * 读者发现 seq_ 为奇数或前后不一致就重读，读路径不加锁。
+     */
+    uint64_t TscToNs(const uint64_t tsc) {
+        uint64_t seq, base_tsc, base_ns;
+        double ns_per_tick;
+        do {
+            seq = seq_.load(std::memory_order_acquire);
+            base_tsc = base_tsc_.load(std::memory_order_relaxed);
+            base_ns = base_ns_.load(std::memory_order_relaxed);
+            ns_per_tick = ns_per_tick_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != seq_.load(std::memory_order_relaxed));
+
+        if (tsc > base_tsc && tsc - base_tsc > resync_ticks_)
+            Resync(seq, base_tsc, base_ns);
+        const auto delta =
+            static_cast<double>(static_cast<int64_t>(tsc - base_tsc));
+        return base_ns + static_cast<int64_t>(delta * ns_per_tick);
+    }
+
+    // 用新的 (TSC, 墙上时间) 对修正频率和基准，只有一个线程能抢到更新
+    void Resync(uint64_t seq, const uint64_t old_tsc, const uint64_t old_ns) {
+        if (!seq_.compare_exchange_strong(seq, seq + 1,
+                                          std::memory_order_acquire))
+            return;
+        const uint64_t tsc = ReadTsc();
+        const uint64_t ns = ReadClock(CLOCK_REALTIME);
+        if (tsc > old_tsc && ns > old_ns) {
+            ns_per_tick_.store(static_cast<double>(ns - old_ns) /
+                                   static_cast<double>(tsc - old_tsc),
+                               std::memory_order_relaxed);
+        }
+        base_tsc_.store(tsc, std::memory_order_relaxed);
+        base_ns_.store(ns, std::memory_order_relaxed);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+  private:
+    Type type_ = Type::REALTIME;
+    std::atomic<uint64_t> seq_{0};
+    std::atomic<uint64_t> base_tsc_{0};
+    std::atomic<uint64_t> base_ns_{0};
+    std::atomic<double> ns_per_tick_{1.0};
+    uint64_t resync_ticks_ = 0; // 大约一秒对应的 TSC 计数
+};
+} // namespace mylog::util
+
+#endif // ASYNCLOG_CLOUDSTORAGE_CLOCK_HPP
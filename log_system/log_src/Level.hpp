@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 
 namespace mylog {
 class LogLevel {
@@ -21,5 +22,17 @@ public:
         }
         return "UNKNOWN";
     }
+    // 配置中的级别名，无法识别时返回 DEBUG(不过滤)
+    static value FromString(const std::string &name) {
+        if (name == "INFO")
+            return value::INFO;
+        if (name == "WARN")
+            return value::WARN;
+        if (name == "ERROR")
+            return value::ERROR;
+        if (name == "FATAL")
+            return value::FATAL;
+        return value::DEBUG;
+    }
 };
 } // namespace mylog
\ No newline at end of file
@@ -14,6 +14,31 @@ class LogFlush {
     using ptr = std::shared_ptr<LogFlush>;
     virtual ~LogFlush() = default;
     virtual void Flush(const char *data, size_t len) = 0;
+    /**
+     * @brief 刷盘屏障时调用，把已写入的数据落到持久介质上
+     * @note 总是在调用 Flush 的同一个线程中调用，实现不需要额外加锁
+     */
+    virtual void Sync() {}
+};
+/**
+ * @brief 输出方向缓存的刷盘策略(flush_log)
+ *
+ * 每批只比较一次配置快照指针，配置热加载后才重新读取。
+ */
+class FlushPolicy {
+  public:
+    size_t Get() {
+        const auto *conf = util::LogConfig::GetJsonData();
+        if (conf != conf_) {
+            conf_ = conf;
+            flush_log_ = conf->flush_log;
+        }
+        return flush_log_;
+    }
+
+  private:
+    const util::LogConfig *conf_ = nullptr;
+    size_t flush_log_ = 0;
 };
 class StdoutFlush final : public LogFlush {
   public:
@@ -21,6 +46,7 @@ class StdoutFlush final : public LogFlush {
     void Flush(const char *data, const size_t len) override {
         std::cout.write(data, static_cast<std::streamsize>(len));
     };
+    void Sync() override { std::cout.flush(); }
 };
 
 class FileFlush final : public LogFlush {
@@ -61,17 +87,25 @@ class FileFlush final : public LogFlush {
          * flush_log == 1: 只刷新文件缓冲区
          * flush_log == 2: 刷新文件缓冲区并同步到磁盘
          */
-        if (util::LogConfig::GetJsonData()->flush_log == 1) {
+        const size_t policy = policy_.Get();
+        if (policy == 1) {
             fflush(fs_);
-        } else if (util::LogConfig::GetJsonData()->flush_log == 2) {
+        } else if (policy == 2) {
             fflush(fs_);
             fsync(fileno(fs_));
         }
     }
+    void Sync() override {
+        if (!fs_)
+            return;
+        fflush(fs_);
+        fsync(fileno(fs_));
+    }
 
   private:
     std::string filename_;
     FILE *fs_ = nullptr;
+    FlushPolicy policy_;
 };
 class RollFileFlush final : public LogFlush {
   public:
@@ -91,16 +125,23 @@ class RollFileFlush final : public LogFlush {
          * flush_log == 1: 只刷新文件缓冲区
          * flush_log == 2: 刷新文件缓冲区并同步到磁盘
          */
-        if(util::LogConfig::GetJsonData()->flush_log == 1){
+        const size_t policy = policy_.Get();
+        if(policy == 1){
             if(fflush(fs_)){
                 std::cout <<__FILE__<<__LINE__<<"fflush file failed"<< std::endl;
                 perror(nullptr);
             }
-        }else if(util::LogConfig::GetJsonData()->flush_log == 2){
+        }else if(policy == 2){
             fflush(fs_);
             fsync(fileno(fs_));
         }
     }
+    void Sync() override {
+        if (fs_ == nullptr)
+            return;
+        fflush(fs_);
+        fsync(fileno(fs_));
+    }
     ~RollFileFlush() override {
         if (fs_ != nullptr) {
             fclose(fs_);
@@ -145,6 +186,7 @@ class RollFileFlush final : public LogFlush {
     size_t cur_size_ = 0;
     size_t cnt_ = 1;
     std::string basename_;
+    FlushPolicy policy_;
 };
 
 } // namespace mylog
@@ -1,51 +1,126 @@
-
 #ifndef ASYNCLOG_CLOUDSTORAGE_MANAGER_HPP
 #define ASYNCLOG_CLOUDSTORAGE_MANAGER_HPP
 #include "AsyncLogger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 namespace mylog {
+/**
+ * @brief 日志器注册表
+ *
+ * 读多写少：日志器只在启动时注册，之后每次打日志都要按名字查找。
+ * 采用写时复制：注册时在写锁内复制当前哈希表、插入新日志器，再原子地
+ * 发布新快照；查找只需原子读出快照指针再查表，不加锁、无等待。
+ * 旧快照保留到注册表析构，读者不需要引用计数也不会访问到已释放的表，
+ * 同时也保证了日志器对象在整个程序生命期内地址不变。
+ */
 class LoggerManager {
   public:
+    using LoggerMap = std::unordered_map<std::string, AsyncLogger::ptr>;
+
     static LoggerManager &GetInstance() {
         static LoggerManager instance;
         return instance;
     }
     bool LoggerExist(const std::string &name) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto it = loggers_.find(name);
-        if (it == loggers_.end())
-            return false;
-        return true;
+        return FindLogger(name) != nullptr;
     }
 
     void AddLogger(const AsyncLogger::ptr &&AsyncLogger) {
-        if (LoggerExist(AsyncLogger->Name()))
-            return;
         std::unique_lock<std::mutex> lock(mutex_);
-        loggers_.insert(std::make_pair(AsyncLogger->Name(), AsyncLogger));
+        const LoggerMap *current = loggers_.load(std::memory_order_relaxed);
+        if (current->count(AsyncLogger->Name()))
+            return;
+        auto next = std::make_unique<LoggerMap>(*current);
+        next->emplace(AsyncLogger->Name(), AsyncLogger);
+        loggers_.store(next.get(), std::memory_order_release);
+        snapshots_.emplace_back(std::move(next));
     }
 
     AsyncLogger::ptr GetLogger(const std::string &name) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto it = loggers_.find(name);
-        if (it == loggers_.end())
+        const LoggerMap *loggers = loggers_.load(std::memory_order_acquire);
+        auto it = loggers->find(name);
+        if (it == loggers->end())
             return AsyncLogger::ptr();
         return it->second;
     }
 
+    /**
+     * @brief 按名字查找日志器，不复制 shared_ptr，避免多线程争用引用计数
+     * @return AsyncLogger* 未注册返回空；返回的指针在注册表存在期间一直有效
+     */
+    AsyncLogger *FindLogger(const std::string &name) const {
+        const LoggerMap *loggers = loggers_.load(std::memory_order_acquire);
+        auto it = loggers->find(name);
+        if (it == loggers->end())
+            return nullptr;
+        return it->second.get();
+    }
+
     AsyncLogger::ptr DefaultLogger() { return default_logger_; }
 
+    /**
+     * @brief 对所有已注册的日志器执行刷盘屏障，总等待时间不超过 timeout
+     * @return bool 全部在超时前完成返回 true
+     */
+    bool FlushAll(const std::chrono::milliseconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        const LoggerMap *loggers = loggers_.load(std::memory_order_acquire);
+        bool ok = true;
+        for (const auto &logger : *loggers) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            ok = logger.second->Flush(std::max(left, std::chrono::milliseconds(0))) && ok;
+        }
+        return ok;
+    }
+
   private:
     LoggerManager() {
         auto builder = std::make_unique<LoggerBuilder>();
         builder->BuildName("default");
         default_logger_ = builder->Build();
-        loggers_.insert(std::make_pair("default", default_logger_));
+        auto loggers = std::make_unique<LoggerMap>();
+        loggers->emplace("default", default_logger_);
+        loggers_.store(loggers.get(), std::memory_order_release);
+        snapshots_.emplace_back(std::move(loggers));
     }
 
   private:
     AsyncLogger::ptr default_logger_;
-    std::mutex mutex_;
-    std::map<std::string, AsyncLogger::ptr> loggers_;
+    std::mutex mutex_; // 只用于串行化注册
+    std::atomic<const LoggerMap *> loggers_{nullptr}; // 当前快照
+    std::vector<std::unique_ptr<const LoggerMap>> snapshots_; // 所有发布过的快照
+};
+
+/**
+ * @brief 缓存的日志器句柄，适合作为函数内的静态局部变量：
+ *
+ *     static mylog::LoggerRef logger("cloud_storage");
+ *     logger->Info("...");
+ *
+ * 第一次使用时解析一次名字，之后只是一次原子读，没有查表和引用计数开销。
+ * 日志器尚未注册时不缓存，下次使用时重新解析。
+ */
+class LoggerRef {
+  public:
+    explicit LoggerRef(std::string name) : name_(std::move(name)) {}
+
+    AsyncLogger *get() {
+        AsyncLogger *logger = logger_.load(std::memory_order_acquire);
+        if (logger == nullptr) {
+            logger = LoggerManager::GetInstance().FindLogger(name_);
+            if (logger != nullptr)
+                logger_.store(logger, std::memory_order_release);
+        }
+        return logger;
+    }
+    AsyncLogger *operator->() { return get(); }
+
+  private:
+    std::string name_;
+    std::atomic<AsyncLogger *> logger_{nullptr};
 };
 } // namespace mylog
 #endif // ASYNCLOG_CLOUDSTORAGE_MANAGER_HPP
@@ -1,4 +1,5 @@
 #pragma once
+#include "Clock.hpp"
 #include "Level.hpp"
 #include "Util.hpp"
 #include <memory>
@@ -15,15 +16,23 @@ struct LogMessage {
     LogMessage(const LogLevel::value level, std::string file, const size_t line,
                std::string message, std::string name)
         : level_(level), filename_(std::move(file)), line_(line),
-          timestamp_(util::Date::Now()), message_(std::move(message)),
+          timestamp_(util::Clock::Now()), message_(std::move(message)),
           logger_name_(std::move(name)), tid_(std::this_thread::get_id()) {}
 
     [[nodiscard]] std::string format() const {
         std::stringstream ret;
-        tm t{};
-        localtime_r(&timestamp_, &t);
+        const timespec ts = util::Clock::ToTimespec(timestamp_);
+        // 同一秒内的日志复用上次 localtime_r + strftime 的结果
+        thread_local time_t cached_sec = -1;
+        thread_local char cached_date[64];
+        if (ts.tv_sec != cached_sec) {
+            tm t{};
+            localtime_r(&ts.tv_sec, &t);
+            strftime(cached_date, sizeof(cached_date), "%Y-%m-%d %H:%M:%S", &t);
+            cached_sec = ts.tv_sec;
+        }
         char buf[128];
-        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
+        snprintf(buf, sizeof(buf), "%s.%09ld", cached_date, ts.tv_nsec);
         const std::string tmp1 = '[' + std::string(buf) + "][";
         const std::string tmp2 = "][" + std::string(LogLevel::ToString(level_)) +
                                  "][" + logger_name_ + "][" + filename_ + ":" +
@@ -36,7 +45,7 @@ struct LogMessage {
     LogLevel::value level_{};
     std::string filename_;
     size_t line_{};
-    time_t timestamp_{};
+    uint64_t timestamp_{}; // util::Clock 的原始计数，格式化时再换算
     std::string message_;
     std::string logger_name_;
     std::thread::id tid_; // 线程id
@@ -0,0 +1,158 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_PAGEREGION_HPP
+#define ASYNCLOG_CLOUDSTORAGE_PAGEREGION_HPP
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+namespace mylog {
+// 缓冲区使用大页的方式，对应配置项 buffer_hugepage
+enum class HugePageMode { NONE = 0, TRANSPARENT = 1, EXPLICIT = 2 };
+
+/**
+ * @brief 基于 mmap 的匿名内存区域，作为日志缓冲区的底层存储
+ *
+ * 1. 映射时只保留地址空间，物理页在第一次写入时才由内核分配，不做清零填充
+ * 2. 扩容用 mremap 移动页表，不拷贝已有数据
+ * 3. Discard 用 madvise 把物理页还给系统，地址空间保留，再次写入时重新缺页
+ * 4. TRANSPARENT 模式对区域 madvise(MADV_HUGEPAGE)；EXPLICIT 模式使用
+ *    MAP_HUGETLB 大页，大页池不足时退回普通页
+ * 5. 指定 NUMA 节点后，每次映射/扩容都用 mbind(MPOL_PREFERRED) 设置内存策略，
+ *    物理页无论由哪个线程首次写入都优先分配在该节点上
+ */
+class PageRegion {
+  public:
+    explicit PageRegion(HugePageMode mode = HugePageMode::NONE) : mode_(mode) {}
+    ~PageRegion() { Free(); }
+    PageRegion(const PageRegion &) = delete;
+    PageRegion &operator=(const PageRegion &) = delete;
+
+    void Swap(PageRegion &other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(mode_, other.mode_);
+        std::swap(hugetlb_, other.hugetlb_);
+        std::swap(numa_node_, other.numa_node_);
+    }
+
+    /**
+     * @brief 设置物理页优先分配的 NUMA 节点，-1 表示使用默认策略
+     */
+    void SetNumaNode(const int node) {
+        numa_node_ = node;
+        Bind(data_, size_);
+    }
+
+    [[nodiscard]] char *Data() const { return data_; }
+    [[nodiscard]] size_t Size() const { return size_; }
+
+    /**
+     * @brief 调整映射大小，保留 min(旧大小, 新大小) 范围内的数据
+     * @param size 需要的字节数，会向上取整到页大小
+     * @throw std::bad_alloc 映射失败
+     */
+    void Resize(size_t size) {
+        size = RoundUp(size);
+        if (size == size_)
+            return;
+        if (data_ == nullptr) {
+            data_ = Map(size, &hugetlb_);
+            size_ = size;
+            Bind(data_, size_);
+            return;
+        }
+        if (hugetlb_) {
+            // hugetlb 映射不保证支持 mremap，重新映射后拷贝
+            bool hugetlb = false;
+            char *p = Map(size, &hugetlb);
+            Bind(p, size);
+            memcpy(p, data_, std::min(size, size_));
+            munmap(data_, size_);
+            data_ = p;
+            hugetlb_ = hugetlb;
+        } else {
+            void *p = mremap(data_, size_, size, MREMAP_MAYMOVE);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+            data_ = static_cast<char *>(p);
+            Advise(size);
+            Bind(data_, size);
+        }
+        size_ = size;
+    }
+
+    /**
+     * @brief 归还物理页，保留地址空间
+     */
+    void Discard() {
+        if (data_ != nullptr)
+            madvise(data_, size_, MADV_DONTNEED);
+    }
+
+    void Free() {
+        if (data_ != nullptr)
+            munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+        hugetlb_ = false;
+    }
+
+  private:
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    [[nodiscard]] size_t RoundUp(const size_t size) const {
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        const size_t align =
+            mode_ == HugePageMode::NONE ? page_size : kHugePageSize;
+        return (size + align - 1) / align * align;
+    }
+
+    void Advise(const size_t size) const {
+        if (mode_ == HugePageMode::TRANSPARENT)
+            madvise(data_, size, MADV_HUGEPAGE);
+    }
+
+    // 直接走系统调用，不依赖 libnuma；内核不支持 NUMA 时调用失败，忽略即可
+    void Bind(char *addr, const size_t size) const {
+        if (addr == nullptr || numa_node_ < 0 ||
+            numa_node_ >= static_cast<int>(sizeof(unsigned long) * 8))
+            return;
+        constexpr int kMpolPreferred = 1;
+        const unsigned long mask = 1UL << numa_node_;
+        syscall(SYS_mbind, addr, size, kMpolPreferred, &mask,
+                sizeof(mask) * 8, 0);
+    }
+
+    char *Map(const size_t size, bool *hugetlb) const {
+        constexpr int prot = PROT_READ | PROT_WRITE;
+        constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        void *p = MAP_FAILED;
+        *hugetlb = false;
+        if (mode_ == HugePageMode::EXPLICIT) {
+            // 大页需要在映射时从大页池预留，失败时退回普通页
+            p = mmap(nullptr, size, prot, flags | MAP_HUGETLB, -1, 0);
+            *hugetlb = p != MAP_FAILED;
+        }
+        if (p == MAP_FAILED)
+            p = mmap(nullptr, size, prot, flags | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        if (mode_ == HugePageMode::TRANSPARENT)
+            madvise(p, size, MADV_HUGEPAGE);
+        return static_cast<char *>(p);
+    }
+
+  private:
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    HugePageMode mode_;
+    bool hugetlb_ = false; // 当前映射是否来自 MAP_HUGETLB
+    int numa_node_ = -1;   // 物理页优先分配的节点，-1 表示不指定
+};
+} // namespace mylog
+
+#endif // ASYNCLOG_CLOUDSTORAGE_PAGEREGION_HPP
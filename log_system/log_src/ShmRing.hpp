@@ -0,0 +1,263 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_SHMRING_HPP
+#define ASYNCLOG_CLOUDSTORAGE_SHMRING_HPP
+#include "Util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mylog {
+/**
+ * @brief 基于文件映射的崩溃保护环形日志
+ *
+ * 文件布局：Header + capacity 字节的环形数据区，每条记录为 4 字节长度 + 数据。
+ * 写入位置 write_pos 和已刷盘位置 flushed_pos 都是单调递增的字节计数，
+ * 对 capacity 取模得到环内偏移。先写记录再发布 write_pos，进程崩溃时写了
+ * 一半的记录不会被看到。映射是 MAP_SHARED 的，进程崩溃后数据仍在页缓存
+ * （/dev/shm 或普通数据文件）中，下次启动时 [flushed_pos, write_pos)
+ * 之间的记录就是已提交但还没写到输出方向的日志。
+ * 环满时丢弃最旧的记录，崩溃现场最需要的是最新的日志。
+ */
+class ShmRing {
+  public:
+    using ptr = std::unique_ptr<ShmRing>;
+
+    /**
+     * @brief 打开或创建环形日志文件，文件内容无效时重新初始化
+     * @return ptr 失败返回空
+     */
+    static ptr Open(const std::string &path, const size_t capacity) {
+        if (capacity == 0)
+            return nullptr;
+        util::File::CreateDirectory(util::File::Path(path));
+        const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cout << __FILE__ << __LINE__ << " open crash ring failed: "
+                      << path << std::endl;
+            perror(nullptr);
+            return nullptr;
+        }
+        const size_t total = sizeof(Header) + capacity;
+        struct stat st {};
+        fstat(fd, &st);
+        if (static_cast<size_t>(st.st_size) != total &&
+            ftruncate(fd, static_cast<off_t>(total)) != 0) {
+            perror("ftruncate crash ring");
+            close(fd);
+            return nullptr;
+        }
+        void *p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0);
+        if (p == MAP_FAILED) {
+            perror("mmap crash ring");
+            close(fd);
+            return nullptr;
+        }
+        ptr ring(new ShmRing(fd, static_cast<char *>(p), capacity));
+        if (!ring->Valid()) {
+            ring->header_->magic = kMagic;
+            ring->header_->capacity = capacity;
+            Store(&ring->header_->write_pos, 0);
+            Store(&ring->header_->flushed_pos, 0);
+        }
+        return ring;
+    }
+
+    ~ShmRing() {
+        munmap(header_, sizeof(Header) + capacity_);
+        close(fd_);
+    }
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    /**
+     * @brief 追加一条记录，调用者负责串行化写入
+     */
+    void Append(const char *data, const size_t len) {
+        const uint64_t need = sizeof(uint32_t) + len;
+        if (need > capacity_)
+            return;
+        const uint64_t write = Load(&header_->write_pos);
+        uint64_t flushed = Load(&header_->flushed_pos);
+        // 空间不足时丢弃最旧的记录
+        while (write + need - flushed > capacity_) {
+            uint32_t old_len;
+            CopyOut(flushed, reinterpret_cast<char *>(&old_len),
+                    sizeof(old_len));
+            flushed += sizeof(uint32_t) + old_len;
+        }
+        Store(&header_->flushed_pos, flushed);
+        const auto len32 = static_cast<uint32_t>(len);
+        CopyIn(write, reinterpret_cast<const char *>(&len32), sizeof(len32));
+        CopyIn(write + sizeof(len32), data, len);
+        Store(&header_->write_pos, write + need);
+    }
+
+    [[nodiscard]] uint64_t WritePos() const { return Load(&header_->write_pos); }
+    [[nodiscard]] uint64_t FlushedPos() const {
+        return Load(&header_->flushed_pos);
+    }
+
+    /**
+     * @brief 标记 pos 之前的记录已写到输出方向
+     */
+    void MarkFlushed(const uint64_t pos) {
+        if (pos > Load(&header_->flushed_pos))
+            Store(&header_->flushed_pos, pos);
+    }
+
+    /**
+     * @brief 按顺序访问所有未刷盘的记录，不分配内存，可在信号处理函数中使用
+     * @param fn 形如 fn(const char *data, size_t len)，跨越环尾的记录分两次回调
+     */
+    template <typename F> void ForEachUnflushed(F &&fn) const {
+        const uint64_t write = Load(&header_->write_pos);
+        uint64_t pos = Load(&header_->flushed_pos);
+        while (pos < write) {
+            uint32_t len;
+            CopyOut(pos, reinterpret_cast<char *>(&len), sizeof(len));
+            pos += sizeof(len);
+            if (pos + len > write)
+                break;
+            const uint64_t off = pos % capacity_;
+            const uint64_t first = std::min<uint64_t>(len, capacity_ - off);
+            fn(data_ + off, first);
+            if (first < len)
+                fn(data_, len - first);
+            pos += len;
+        }
+    }
+
+  private:
+    static constexpr uint64_t kMagic = 0x474e49524c594d31; // "1MYLRING"
+
+    struct Header {
+        uint64_t magic;
+        uint64_t capacity;
+        uint64_t write_pos;
+        uint64_t flushed_pos;
+    };
+
+    ShmRing(const int fd, char *base, const size_t capacity)
+        : fd_(fd), header_(reinterpret_cast<Header *>(base)),
+          data_(base + sizeof(Header)), capacity_(capacity) {}
+
+    // 映射区里的计数器直接用编译器原子内建函数读写
+    static uint64_t Load(const uint64_t *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void Store(uint64_t *p, const uint64_t v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    [[nodiscard]] bool Valid() const {
+        const uint64_t write = Load(&header_->write_pos);
+        const uint64_t flushed = Load(&header_->flushed_pos);
+        return header_->magic == kMagic && header_->capacity == capacity_ &&
+               flushed <= write && write - flushed <= capacity_;
+    }
+
+    void CopyIn(const uint64_t pos, const char *src, const size_t len) {
+        const uint64_t off = pos % capacity_;
+        const uint64_t first = std::min<uint64_t>(len, capacity_ - off);
+        memcpy(data_ + off, src, first);
+        memcpy(data_, src + first, len - first);
+    }
+    void CopyOut(const uint64_t pos, char *dst, const size_t len) const {
+        const uint64_t off = pos % capacity_;
+        const uint64_t first = std::min<uint64_t>(len, capacity_ - off);
+        memcpy(dst, data_ + off, first);
+        memcpy(dst + first, data_, len - first);
+    }
+
+  private:
+    int fd_;
+    Header *header_;
+    char *data_;
+    size_t capacity_;
+};
+
+/**
+ * @brief 进程收到致命信号时需要尽力刷出日志的对象
+ */
+class CrashDrainTask {
+  public:
+    virtual ~CrashDrainTask() = default;
+    virtual void EmergencyDrain() = 0;
+};
+
+/**
+ * @brief 致命信号钩子
+ *
+ * 第一次注册时为 SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT 安装处理函数。
+ * 收到信号后依次让注册的对象同步刷出环形日志，然后恢复原来的处理方式
+ * 并重新触发信号，保留 core dump 和原有的信号处理链。
+ * 这只是尽力而为：刷盘路径里有 stdio 调用，并不是异步信号安全的。
+ */
+class CrashGuard {
+  public:
+    static void Register(CrashDrainTask *task) {
+        static std::once_flag once;
+        std::call_once(once, Install);
+        for (auto &slot : Slots()) {
+            CrashDrainTask *expected = nullptr;
+            if (slot.compare_exchange_strong(expected, task))
+                return;
+        }
+    }
+    static void Unregister(CrashDrainTask *task) {
+        for (auto &slot : Slots()) {
+            CrashDrainTask *expected = task;
+            if (slot.compare_exchange_strong(expected, nullptr))
+                return;
+        }
+    }
+
+  private:
+    static constexpr int kMaxTasks = 64;
+    static constexpr int kSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL,
+                                       SIGABRT};
+
+    static std::atomic<CrashDrainTask *> (&Slots())[kMaxTasks] {
+        static std::atomic<CrashDrainTask *> slots[kMaxTasks];
+        return slots;
+    }
+    static struct sigaction *OldActions() {
+        static struct sigaction old_actions[NSIG];
+        return old_actions;
+    }
+
+    static void Install() {
+        struct sigaction sa {};
+        sa.sa_handler = Handler;
+        sigemptyset(&sa.sa_mask);
+        for (int sig : kSignals) {
+            sigaction(sig, &sa, &OldActions()[sig]);
+        }
+    }
+
+    static void Handler(const int sig) {
+        static std::atomic<bool> entered{false};
+        if (!entered.exchange(true)) {
+            for (auto &slot : Slots()) {
+                CrashDrainTask *task = slot.load();
+                if (task != nullptr)
+                    task->EmergencyDrain();
+            }
+        }
+        sigaction(sig, &OldActions()[sig], nullptr);
+        raise(sig);
+    }
+};
+} // namespace mylog
+
+#endif // ASYNCLOG_CLOUDSTORAGE_SHMRING_HPP
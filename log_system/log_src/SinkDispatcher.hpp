@@ -0,0 +1,140 @@
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_SINKDISPATCHER_HPP
+#define ASYNCLOG_CLOUDSTORAGE_SINKDISPATCHER_HPP
+#include "LogFlush.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mylog {
+/**
+ * @brief 为单个输出方向服务的分发线程
+ *
+ * 日志器的工作线程把一批数据拷贝成只读的共享批次，提交给每个输出方向的
+ * 分发器；各分发器在自己的线程里消费，全部消费完后批次随引用计数释放。
+ * 每个分发器有独立的积压上限。lossy 为 true 时超过上限的批次直接丢弃并
+ * 在之后补写一条丢弃提示，慢的输出方向不会拖住日志器和其他输出方向；
+ * 为 false 时提交方等待积压降到上限以下，不丢日志(ASYNC_SAFE 日志器)。
+ */
+class SinkDispatcher {
+  public:
+    using ptr = std::shared_ptr<SinkDispatcher>;
+    using Batch = std::shared_ptr<const std::string>;
+
+    SinkDispatcher(LogFlush::ptr flush, const size_t backlog_limit,
+                   const bool lossy)
+        : flush_(std::move(flush)), backlog_limit_(backlog_limit),
+          lossy_(lossy), thread_(&SinkDispatcher::ThreadEntry, this) {}
+
+    // 析构时把已提交的批次写完再退出
+    ~SinkDispatcher() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    /**
+     * @brief 提交一批数据，积压超过上限时丢弃或等待
+     * @return bool 成功入队返回 true
+     */
+    bool Submit(const Batch &batch) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // 没有积压时总是接受，避免单批超过上限的数据永远写不出去
+            auto full = [&]() {
+                return backlog_ > 0 && backlog_ + batch->size() > backlog_limit_;
+            };
+            if (lossy_ && full()) {
+                dropped_ += batch->size();
+                return false;
+            }
+            cond_space_.wait(lock, [&]() { return !full(); });
+            queue_.push_back(batch);
+            backlog_ += batch->size();
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 等待已提交的批次全部写完，再在分发线程中同步输出方向
+     * @note 由日志器的消费者线程调用，等待期间不会有新批次提交
+     */
+    void Sync() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const uint64_t gen = ++sync_requested_;
+        cond_.notify_one();
+        cond_synced_.wait(lock, [&]() { return sync_done_ >= gen; });
+    }
+
+  private:
+    void ThreadEntry() {
+        while (true) {
+            Batch batch;
+            size_t dropped;
+            uint64_t sync_gen = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&]() {
+                    return !queue_.empty() || stop_ ||
+                           sync_requested_ != sync_done_;
+                });
+                if (queue_.empty() && dropped_ == 0 &&
+                    sync_requested_ == sync_done_)
+                    return;
+                if (!queue_.empty()) {
+                    batch = std::move(queue_.front());
+                    queue_.pop_front();
+                } else if (sync_requested_ != sync_done_) {
+                    // 队列已空，之前提交的批次都已写完
+                    sync_gen = sync_requested_;
+                }
+                dropped = dropped_;
+                dropped_ = 0;
+            }
+            if (dropped > 0) {
+                const std::string note = "[mylog] sink backlog full, dropped " +
+                                         std::to_string(dropped) + " bytes\n";
+                flush_->Flush(note.data(), note.size());
+            }
+            if (batch) {
+                flush_->Flush(batch->data(), batch->size());
+                std::unique_lock<std::mutex> lock(mutex_);
+                backlog_ -= batch->size();
+                cond_space_.notify_all();
+            }
+            if (sync_gen != 0) {
+                flush_->Sync();
+                std::unique_lock<std::mutex> lock(mutex_);
+                sync_done_ = sync_gen;
+                cond_synced_.notify_all();
+            }
+        }
+    }
+
+  private:
+    LogFlush::ptr flush_;
+    size_t backlog_limit_;   // 积压上限(字节)，包括正在写的批次
+    bool lossy_;             // 超过上限时丢弃，否则等待
+    size_t backlog_ = 0;     // 当前积压字节数
+    size_t dropped_ = 0;     // 尚未报告的丢弃字节数
+    bool stop_ = false;
+    uint64_t sync_requested_ = 0; // 已请求的同步代数
+    uint64_t sync_done_ = 0;      // 已完成的同步代数
+    std::deque<Batch> queue_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable cond_synced_; // 通知 Sync 等待者
+    std::condition_variable cond_space_;  // 通知等待积压下降的提交方
+    std::thread thread_;
+};
+} // namespace mylog
+
+#endif // ASYNCLOG_CLOUDSTORAGE_SINKDISPATCHER_HPP
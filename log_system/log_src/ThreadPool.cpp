@@ -1,137 +1,406 @@
 #include "ThreadPool.hpp"
+#include "Affinity.hpp"
+#include "TimerWheel.hpp"
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
 #include <mutex>
+#include <pthread.h>
+#include <sched.h>
 #include <thread>
 #include <utility>
 
+namespace {
+// 超出最小线程数的线程空闲这么久后退出
+constexpr auto kIdleTimeout = chrono::seconds(10);
+// 睡眠前让出 CPU 重新查找任务的次数，避免细粒度任务下频繁睡眠/唤醒
+constexpr int kSpinRounds = 64;
+
+// 当前线程所属的线程池及槽位下标，用于把工作线程内提交的任务放入本地队列
+thread_local ThreadPool *t_pool = nullptr;
+thread_local int t_index = -1;
+} // namespace
+
 ThreadPool::ThreadPool(int min, int max)
-    : m_minThread(min), m_maxThread(max), m_idleThread(min), m_curThread(min),
-      m_stop(false) {
-    cout << "ThreadPool created (min=" << min << ", max=" << max << ")" << endl;
-    m_manager = new thread(&ThreadPool::manager, this);
+    : m_minThread(min), m_maxThread(std::max(min, max)), m_idleThread(0),
+      m_wakeups(0), m_curThread(0), m_pending(0), m_stop(false) {
+    cerr << "ThreadPool created (min=" << min << ", max=" << max << ")" << endl;
+    for (int i = 0; i < m_maxThread; ++i) {
+        m_slots.emplace_back(make_unique<WorkerSlot>());
+    }
+    m_timers = make_unique<TimerWheel>(
+        [this](Task task) { submit(std::move(task)); });
     for (int i = 0; i < min; ++i) {
-        thread t(&ThreadPool::worker, this);
-        m_workers.insert(make_pair(t.get_id(), std::move(t)));
+        spawnWorker();
     }
 };
 
 ThreadPool::~ThreadPool() {
-    cout << "Destroying ThreadPool..." << endl;
-    m_stop.store(true);
+    cerr << "Destroying ThreadPool..." << endl;
+    // 先停时间轮，之后不会再有到期任务提交进来
+    m_timers.reset();
+    {
+        lock_guard<mutex> locker(m_parkMutex);
+        m_stop.store(true);
+    }
     m_condition.notify_all();
+    // 等正在进行的 spawnWorker 结束，之后不会再创建线程；
+    // join 时不能持有 m_spawnMutex，任务里可能还在提交任务
+    { lock_guard<mutex> locker(m_spawnMutex); }
 
-    // 等待所有工作线程结束
-    for (auto &it : m_workers) {
-        thread &t = it.second;
-        if (t.joinable()) {
-            t.join();
+    // 等待所有工作线程执行完剩余任务并退出
+    for (auto &slot : m_slots) {
+        if (slot->worker.joinable()) {
+            slot->worker.join();
         }
     }
+    cerr << "ThreadPool destroyed successfully" << endl;
+}
 
-    // 等待管理者线程结束
-    if (m_manager && m_manager->joinable()) {
-        m_manager->join();
-        delete m_manager;
-        m_manager = nullptr;
+void ThreadPool::addTask(function<void(void)> task) {
+    submit(Task(std::move(task)));
+}
+
+ThreadPool::TimerId ThreadPool::scheduleAfter(chrono::milliseconds delay,
+                                              function<void(void)> task) {
+    return m_timers->add(delay, chrono::milliseconds(0), std::move(task));
+}
+
+ThreadPool::TimerId ThreadPool::scheduleEvery(chrono::milliseconds period,
+                                              function<void(void)> task) {
+    return m_timers->add(period, period, std::move(task));
+}
+
+bool ThreadPool::cancelTimer(TimerId id) { return m_timers->cancel(id); }
+
+ThreadPool::ClassId ThreadPool::addClass(const string &name, int priority,
+                                         int maxConcurrency, size_t maxQueue) {
+    lock_guard<mutex> locker(m_classMutex);
+    ClassId existing = findClass(name);
+    if (existing != kDefaultClass) {
+        return existing;
+    }
+    const int count = m_classCount.load();
+    if (count >= kMaxClasses) {
+        throw runtime_error("too many thread pool classes");
     }
+    auto sc = make_unique<SchedClass>();
+    sc->name = name;
+    sc->priority = priority;
+    sc->maxConcurrency = std::max(0, maxConcurrency);
+    sc->maxQueue = maxQueue;
+    m_classes[count + 1] = std::move(sc);
+    // 先写好类再发布数量，工作线程按数量遍历时看到的都是完整的类
+    m_classCount.store(count + 1, memory_order_release);
+    return count + 1;
+}
 
-    m_workers.clear();
-    cout << "ThreadPool destroyed successfully" << endl;
+ThreadPool::ClassId ThreadPool::findClass(const string &name) const {
+    const int count = m_classCount.load(memory_order_acquire);
+    for (int i = 1; i <= count; ++i) {
+        if (m_classes[i]->name == name) {
+            return i;
+        }
+    }
+    return kDefaultClass;
 }
-void ThreadPool::addTask(function<void(void)> task) {
+
+ThreadPool::ClassStats ThreadPool::classStats(ClassId cls) const {
+    ClassStats stats;
+    if (cls <= kDefaultClass || cls > m_classCount.load(memory_order_acquire)) {
+        return stats;
+    }
+    SchedClass &sc = *m_classes[cls];
+    stats.name = sc.name;
+    stats.priority = sc.priority;
+    stats.maxConcurrency = sc.maxConcurrency;
+    stats.maxQueue = sc.maxQueue;
     {
-        lock_guard<mutex> locker(m_queueMutex);
-        m_tasks.emplace(task);
-    }
-    m_condition.notify_one();
-}
-
-void ThreadPool::manager(void) {
-    while (!m_stop.load()) {
-        this_thread::sleep_for(chrono::seconds(1));
-        int idel = m_idleThread.load();
-        int cur = m_curThread.load();
-
-        // 线程退出
-        if (idel > cur / 2 && cur > m_minThread) {
-            // cout << "Manager: Too many idle threads, exiting some threads"
-            //      << endl;
-            m_exitThread.store(2);
-            m_condition.notify_all();
-            // 等待直到有线程添加了退出
-            while (m_ids.empty() && m_exitThread.load() > 0) {
-                this_thread::sleep_for(chrono::milliseconds(10));
-            }
-            // 清理已退出的线程
-            {
-                lock_guard<mutex> idLocker(m_idsMutex);
-                for (auto id : m_ids) {
-                    auto it = m_workers.find(id);
-                    if (it != m_workers.end()) {
-                        if (it->second.joinable()) {
-                            it->second.join();
-                        }
-                        m_workers.erase(it);
-                    }
-                }
-                m_ids.clear(); // 清空已处理的ID列表
-            }
-        } else if (idel == 0 && cur < m_maxThread &&
-                   !m_stop.load()) { // 添加停止检查
-            // cout << "Manager: No idle threads, creating new thread" << endl;
-            thread t(&ThreadPool::worker, this);
-            m_workers.insert(make_pair(t.get_id(), std::move(t)));
-            m_curThread++;
-            m_idleThread++;
+        lock_guard<mutex> locker(sc.lock);
+        stats.queued = sc.tasks.size();
+        stats.running = sc.running;
+    }
+    stats.completed = sc.completed.load();
+    stats.rejected = sc.rejected.load();
+    stats.waitHist = sc.waitHist.snapshot();
+    stats.runHist = sc.runHist.snapshot();
+    return stats;
+}
+
+vector<ThreadPool::ClassStats> ThreadPool::allClassStats(void) const {
+    vector<ClassStats> all;
+    const int count = m_classCount.load(memory_order_acquire);
+    for (int i = 1; i <= count; ++i) {
+        all.push_back(classStats(i));
+    }
+    return all;
+}
+
+bool ThreadPool::submitTo(ClassId cls, Task task) {
+    if (cls <= kDefaultClass || cls > m_classCount.load(memory_order_acquire)) {
+        submit(std::move(task));
+        return true;
+    }
+    SchedClass &sc = *m_classes[cls];
+    long delta;
+    {
+        lock_guard<mutex> locker(sc.lock);
+        if (sc.maxQueue > 0 && sc.tasks.size() >= sc.maxQueue) {
+            sc.rejected++;
+            return false;
+        }
+        sc.tasks.push_back({std::move(task), chrono::steady_clock::now()});
+        delta = updateRunnable(sc);
+    }
+    if (delta > 0) {
+        wakeOrSpawn(delta);
+    }
+    return true;
+}
+
+long ThreadPool::updateRunnable(SchedClass &sc) {
+    // 调用者持有 sc.lock。可执行数 = min(排队数, 剩余并发额度)，
+    // 只有这部分计入 m_pending，受并发上限压住的任务不会让工作线程空转
+    long avail = static_cast<long>(sc.tasks.size());
+    if (sc.maxConcurrency > 0) {
+        avail = std::min<long>(avail, std::max(0, sc.maxConcurrency - sc.running));
+    }
+    const long delta = avail - sc.runnable.load(memory_order_relaxed);
+    if (delta != 0) {
+        sc.runnable.store(avail, memory_order_relaxed);
+        m_pending.fetch_add(delta);
+    }
+    return delta;
+}
+
+bool ThreadPool::popClassTask(bool highPriority, Task &task, SchedClass *&cls) {
+    // 在符合优先级范围、有可执行任务的类里选优先级最高的
+    const int count = m_classCount.load(memory_order_acquire);
+    SchedClass *best = nullptr;
+    for (int i = 1; i <= count; ++i) {
+        SchedClass *sc = m_classes[i].get();
+        if ((sc->priority > 0) != highPriority ||
+            sc->runnable.load(memory_order_relaxed) <= 0) {
+            continue;
+        }
+        if (best == nullptr || sc->priority > best->priority) {
+            best = sc;
+        }
+    }
+    if (best == nullptr) {
+        return false;
+    }
+    chrono::steady_clock::time_point enqueued;
+    {
+        lock_guard<mutex> locker(best->lock);
+        if (best->tasks.empty() || (best->maxConcurrency > 0 &&
+                                    best->running >= best->maxConcurrency)) {
+            return false;
         }
+        auto entry = best->tasks.pop_front();
+        task = std::move(entry.task);
+        enqueued = entry.enqueued;
+        best->running++;
+        updateRunnable(*best);
     }
-    cout << "Manager thread exiting" << endl;
+    best->waitHist.record(static_cast<uint64_t>(
+        chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - enqueued)
+            .count()));
+    cls = best;
+    return true;
 }
 
-void ThreadPool::worker(void) {
+void ThreadPool::finishClassTask(SchedClass &sc) {
+    long delta;
+    {
+        lock_guard<mutex> locker(sc.lock);
+        sc.running--;
+        delta = updateRunnable(sc);
+    }
+    sc.completed++;
+    // 腾出的并发额度让排队的任务变成可执行，可能需要唤醒睡眠的线程
+    if (delta > 0) {
+        wakeOrSpawn(delta);
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    auto [lock, queue] = submitQueue();
+    {
+        lock_guard<mutex> locker(*lock);
+        queue->push_back(std::move(task));
+        // 持锁时计数：任务被取走前计数一定已经加上
+        m_pending.fetch_add(1);
+    }
+    wakeOrSpawn(1);
+}
+
+pair<mutex *, TaskQueue *> ThreadPool::submitQueue(void) {
+    // 工作线程内提交的任务进本地队列，外部线程的进全局注入队列
+    if (t_pool == this) {
+        WorkerSlot &slot = *m_slots[t_index];
+        return {&slot.lock, &slot.tasks};
+    }
+    return {&m_globalMutex, &m_global};
+}
+
+void ThreadPool::wakeOrSpawn(long count) {
+    // 与 worker 中"先登记睡眠再检查 m_pending"配对，二者至少有一方看到对方。
+    // 已被唤醒但还没运行的线程醒来后会把任务取完，不必再次唤醒它，
+    // 否则单核上生产者每次提交都要做一次无用的 futex 唤醒
+    if (m_idleThread.load() <= m_wakeups.load() &&
+        m_curThread.load() >= m_maxThread.load())
+        return;
+    long spawn = 0;
+    {
+        lock_guard<mutex> locker(m_parkMutex);
+        const long sleeping = m_idleThread.load() - m_wakeups.load();
+        const long wake = std::min(count, std::max(0L, sleeping));
+        for (long i = 0; i < wake; ++i) {
+            m_condition.notify_one();
+        }
+        m_wakeups += static_cast<int>(wake);
+        spawn = std::min<long>(count - wake,
+                               m_maxThread.load() - m_curThread.load());
+    }
+    for (long i = 0; i < spawn; ++i) {
+        spawnWorker();
+    }
+}
+
+void ThreadPool::setCpuAffinity(const vector<int> &cpus) {
+    lock_guard<mutex> locker(m_spawnMutex);
+    m_cpus = cpus;
+    for (auto &slot : m_slots) {
+        if (slot->running.load()) {
+            mylog::util::Affinity::Pin(slot->worker.native_handle(), m_cpus);
+        }
+    }
+}
+
+void ThreadPool::spawnWorker(void) {
+    lock_guard<mutex> locker(m_spawnMutex);
+    if (m_stop.load() || m_curThread.load() >= m_maxThread.load())
+        return;
+    for (int i = 0; i < m_maxThread; ++i) {
+        WorkerSlot &slot = *m_slots[i];
+        if (slot.running.load())
+            continue;
+        // 槽位上的旧线程已经退出，回收后复用
+        if (slot.worker.joinable()) {
+            slot.worker.join();
+        }
+        slot.running.store(true);
+        m_curThread++;
+        slot.worker = thread(&ThreadPool::worker, this, i);
+        mylog::util::Affinity::Pin(slot.worker.native_handle(), m_cpus);
+        return;
+    }
+}
+
+bool ThreadPool::popTask(int index, Task &task, SchedClass *&cls) {
+    cls = nullptr;
+    // 0. 高优先级调度类
+    if (popClassTask(true, task, cls)) {
+        return true;
+    }
+    // 1. 本地队列队尾
+    {
+        WorkerSlot &slot = *m_slots[index];
+        lock_guard<mutex> locker(slot.lock);
+        if (!slot.tasks.empty()) {
+            task = slot.tasks.pop_back();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+    }
+    // 2. 全局注入队列
+    {
+        lock_guard<mutex> locker(m_globalMutex);
+        if (!m_global.empty()) {
+            task = m_global.pop_front();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+    }
+    // 3. 从其他线程的队头窃取，从相邻槽位开始以分散竞争
+    const int n = static_cast<int>(m_slots.size());
+    for (int k = 1; k < n; ++k) {
+        WorkerSlot &victim = *m_slots[(index + k) % n];
+        unique_lock<mutex> locker(victim.lock, try_to_lock);
+        if (!locker.owns_lock() || victim.tasks.empty())
+            continue;
+        task = victim.tasks.pop_front();
+        m_pending.fetch_sub(1);
+        return true;
+    }
+    // 4. 低优先级调度类
+    return popClassTask(false, task, cls);
+}
+
+void ThreadPool::worker(int index) {
     thread::id tid = this_thread::get_id();
-    cout << "Worker thread " << tid << " started" << endl;
-
-    while (!m_stop.load()) {
-        function<void(void)> task;
-        {
-            unique_lock<mutex> locker(m_queueMutex);
-            while (m_tasks.empty() && !m_stop.load()) {
-                // cout << "Worker thread " << tid << " waiting for task" << endl;
-                m_condition.wait(locker);
+    cerr << "Worker thread " << tid << " started" << endl;
+    t_pool = this;
+    t_index = index;
 
-                // 检查是否需要退出
-                if (m_exitThread.load() > 0) {
-                    // cout << "Worker thread " << tid << " received exit signal"
-                    //      << endl;
-                    m_curThread--;
-                    m_idleThread--;
-                    m_exitThread--;
-                    lock_guard<mutex> idLocker(m_idsMutex);
-                    m_ids.emplace_back(tid);
-                    // cout << "Worker thread " << tid << " added to exit list"
-                    //      << endl;
-                    return;
-                }
+    Task task;
+    SchedClass *cls = nullptr;
+    int spins = 0;
+    while (true) {
+        if (popTask(index, task, cls)) {
+            if (cls == nullptr) {
+                task();
+                task.reset();
+            } else {
+                const auto start = chrono::steady_clock::now();
+                task();
+                task.reset();
+                cls->runHist.record(static_cast<uint64_t>(
+                    chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - start)
+                        .count()));
+                finishClassTask(*cls);
             }
+            spins = 0;
+            continue;
+        }
+        // 有任务在途(可能正在入队或窃取时没抢到锁)时不睡眠
+        if (m_pending.load() > 0 || ++spins < kSpinRounds) {
+            this_thread::yield();
+            continue;
+        }
+        spins = 0;
 
-            if (!m_tasks.empty()) {
-                // cout << "Worker thread " << tid << " got a task" << endl;
-                task = std::move(m_tasks.front());
-                m_tasks.pop();
+        unique_lock<mutex> locker(m_parkMutex);
+        m_idleThread++;
+        bool retire = false;
+        while (m_pending.load() == 0 && !m_stop.load()) {
+            if (index < m_minThread.load()) {
+                m_condition.wait(locker);
+            } else if (m_condition.wait_for(locker, kIdleTimeout) ==
+                           cv_status::timeout &&
+                       m_pending.load() == 0 && !m_stop.load()) {
+                retire = true;
+                break;
             }
         }
-
-        if (task) {
-            // cout << "Worker thread " << tid << " executing task" << endl;
-            m_idleThread--;
-            task();
-            m_idleThread++;
-            // cout << "Worker thread " << tid << " finished task" << endl;
+        m_idleThread--;
+        if (m_wakeups.load() > 0) {
+            m_wakeups--;
+        }
+        if (retire || (m_stop.load() && m_pending.load() == 0)) {
+            if (retire) {
+                m_curThread--;
+            }
+            break;
         }
     }
 
-    cout << "Worker thread " << tid << " exiting" << endl;
+    cerr << "Worker thread " << tid << " exiting" << endl;
+    t_pool = nullptr;
+    m_slots[index]->running.store(false);
 }
-
@@ -6,58 +6,417 @@
 #include <thread>
 #include <vector>
 #include <atomic>
-#include <queue>
 #include <functional>
 #include <mutex>
-#include <map>
 #include <future>
 #include <memory>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <new>
+#include <tuple>
+#include <type_traits>
 #include <condition_variable>
 
 using namespace std;
 
+class TimerWheel;
+
+/**
+ * 线程池任务：只能移动的类型擦除可调用对象
+ *
+ * 不超过 kInlineSize 字节、可无异常移动的可调用对象直接存放在对象内部，
+ * 不分配堆内存；更大的对象退回到堆上。相比 std::function 不要求可拷贝，
+ * 可以直接保存 promise、unique_ptr 等只能移动的状态。
+ */
+class PoolTask {
+public:
+    static constexpr size_t kInlineSize = 48;
+
+    PoolTask() noexcept = default;
+    template<typename F, typename = enable_if_t<!is_same_v<decay_t<F>, PoolTask>>>
+    PoolTask(F&& f) {
+        using Fn = decay_t<F>;
+        if constexpr (sizeof(Fn) <= kInlineSize &&
+                      alignof(Fn) <= alignof(max_align_t) &&
+                      is_nothrow_move_constructible_v<Fn>) {
+            new (m_storage) Fn(forward<F>(f));
+            m_ops = &InlineOps<Fn>::ops;
+        } else {
+            *reinterpret_cast<Fn**>(m_storage) = new Fn(forward<F>(f));
+            m_ops = &HeapOps<Fn>::ops;
+        }
+    }
+    PoolTask(PoolTask&& other) noexcept { moveFrom(other); }
+    PoolTask& operator=(PoolTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    PoolTask(const PoolTask&) = delete;
+    PoolTask& operator=(const PoolTask&) = delete;
+    ~PoolTask() { reset(); }
+
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+    void operator()() { m_ops->invoke(m_storage); }
+    void reset() noexcept {
+        if (m_ops) {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src); // 移动构造到 dst 并销毁 src
+        void (*destroy)(void*);
+    };
+    template<typename Fn> struct InlineOps {
+        static void invoke(void* p) { (*static_cast<Fn*>(p))(); }
+        static void move(void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+        static void destroy(void* p) { static_cast<Fn*>(p)->~Fn(); }
+        static constexpr Ops ops{invoke, move, destroy};
+    };
+    template<typename Fn> struct HeapOps {
+        static void invoke(void* p) { (**static_cast<Fn**>(p))(); }
+        static void move(void* dst, void* src) {
+            *static_cast<Fn**>(dst) = *static_cast<Fn**>(src);
+        }
+        static void destroy(void* p) { delete *static_cast<Fn**>(p); }
+        static constexpr Ops ops{invoke, move, destroy};
+    };
+
+    void moveFrom(PoolTask& other) noexcept {
+        if (other.m_ops) {
+            other.m_ops->move(m_storage, other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    alignas(max_align_t) unsigned char m_storage[kInlineSize];
+    const Ops* m_ops = nullptr;
+};
+
+/**
+ * 任务环形队列：容量按 2 的幂增长且不收缩，稳定运行后入队出队不分配内存
+ * (std::deque 会随着入队出队反复申请释放节点)。不加锁，由使用者保护。
+ */
+template<typename T>
+class RingQueue {
+public:
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    void push_back(T&& item) {
+        if (m_size == m_slots.size()) {
+            grow();
+        }
+        m_slots[(m_head + m_size) & (m_slots.size() - 1)] = std::move(item);
+        ++m_size;
+    }
+    template<typename F>
+    void emplace_back(F&& f) {
+        push_back(T(forward<F>(f)));
+    }
+    T pop_front() {
+        T item = std::move(m_slots[m_head]);
+        m_head = (m_head + 1) & (m_slots.size() - 1);
+        --m_size;
+        return item;
+    }
+    T pop_back() {
+        --m_size;
+        return std::move(m_slots[(m_head + m_size) & (m_slots.size() - 1)]);
+    }
+
+private:
+    void grow() {
+        vector<T> slots(m_slots.empty() ? 64 : m_slots.size() * 2);
+        for (size_t i = 0; i < m_size; ++i) {
+            slots[i] = std::move(m_slots[(m_head + i) & (m_slots.size() - 1)]);
+        }
+        m_slots.swap(slots);
+        m_head = 0;
+    }
+
+    vector<T> m_slots;
+    size_t m_head = 0;
+    size_t m_size = 0;
+};
+using TaskQueue = RingQueue<PoolTask>;
+
+/**
+ * 延迟直方图：按微秒数的二进制位数分桶，第 i 桶记录 [2^(i-1), 2^i) 微秒，
+ * 记录只是一次原子加
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kBuckets = 40;
+
+    void record(uint64_t us) {
+        int bucket = 0;
+        while (us > 0 && bucket < kBuckets - 1) {
+            us >>= 1;
+            ++bucket;
+        }
+        m_buckets[bucket].fetch_add(1, memory_order_relaxed);
+    }
+    vector<uint64_t> snapshot(void) const {
+        vector<uint64_t> counts(kBuckets);
+        for (int i = 0; i < kBuckets; ++i) {
+            counts[i] = m_buckets[i].load(memory_order_relaxed);
+        }
+        return counts;
+    }
+    // 返回 p 分位所在桶的上界(微秒)，没有记录时返回 0
+    static uint64_t percentile(const vector<uint64_t>& counts, double p) {
+        uint64_t total = 0;
+        for (auto c : counts) {
+            total += c;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const auto target = static_cast<uint64_t>(p * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen > target) {
+                return i == 0 ? 0 : (uint64_t(1) << i) - 1;
+            }
+        }
+        return (uint64_t(1) << (counts.size() - 1)) - 1;
+    }
+
+private:
+    atomic<uint64_t> m_buckets[kBuckets] = {};
+};
+
+/**
+ * 工作窃取线程池
+ *
+ * 每个工作线程有自己的双端队列，工作线程内提交的任务压入自己的队尾并从队尾取
+ * (LIFO，缓存友好)；外部线程提交的任务进入全局注入队列。工作线程依次从本地
+ * 队列、全局队列取任务，都为空时从其他线程的队头窃取。没有任务时线程在条件
+ * 变量上睡眠，提交任务时只在有线程睡眠时才唤醒，没有空闲线程且未达上限时
+ * 立即创建新线程；超出最小线程数的线程空闲一段时间后自行退出。
+ *
+ * 调度类：可以注册带优先级、并发上限和队列长度上限的命名调度类，通过
+ * addTaskTo/postTo 提交到指定类。优先级大于 0 的类先于普通任务执行，其余
+ * 在普通任务之后执行；同一时刻某类正在执行的任务数不超过并发上限，超出的
+ * 留在类队列里，不占用工作线程。每个类分别统计排队等待和执行耗时直方图。
+ */
 class ThreadPool {
 public:
+    using Task = PoolTask;
+    using TimerId = uint64_t;
+    using ClassId = int;
+    static constexpr ClassId kDefaultClass = 0; // 普通任务，不限流不统计
+
+    // 调度类的统计快照
+    struct ClassStats {
+        string name;
+        int priority = 0;
+        int maxConcurrency = 0;
+        size_t maxQueue = 0;
+        size_t queued = 0;      // 排队中的任务数
+        int running = 0;        // 正在执行的任务数
+        uint64_t completed = 0; // 已完成的任务数
+        uint64_t rejected = 0;  // 因队列满被拒绝的任务数
+        vector<uint64_t> waitHist; // 排队等待耗时直方图(微秒)
+        vector<uint64_t> runHist;  // 执行耗时直方图(微秒)
+    };
+
     explicit ThreadPool(int min = 2,int max = std::thread::hardware_concurrency());
     ~ThreadPool();
 
     // 添加任务到任务队列
     void addTask(function<void(void)> task);
+    // 添加任务并通过 future 取得返回值或异常，只为 promise 的共享状态分配一次内存
     template<typename F, typename... Args>
-    auto addTask(F&& f, Args&&... args)->future<typename result_of<F(Args...)>::type> {
-        // 1. 创建一个 packaged_task 实例
-        using returnType = typename result_of<F(Args...)>::type;
-        auto mytask = make_shared<packaged_task<returnType()>> (
-            bind(forward<F>(f), forward<Args>(args)...));
-        // 2. 得到 future
-        future<returnType> res = mytask->get_future();
-        // 3. 将 packaged_task 添加到任务队列
+    auto addTask(F&& f, Args&&... args)->future<invoke_result_t<F, Args...>> {
+        using returnType = invoke_result_t<F, Args...>;
+        promise<returnType> prom;
+        future<returnType> res = prom.get_future();
+        submit(Task([prom = std::move(prom), fn = forward<F>(f),
+                     params = make_tuple(forward<Args>(args)...)]() mutable {
+            try {
+                if constexpr (is_void_v<returnType>) {
+                    apply(fn, std::move(params));
+                    prom.set_value();
+                } else {
+                    prom.set_value(apply(fn, std::move(params)));
+                }
+            } catch (...) {
+                prom.set_exception(current_exception());
+            }
+        }));
+        return res;
+    }
+    // 只执行不取结果，小任务不分配任何内存
+    template<typename F>
+    void post(F&& f) {
+        submit(Task(forward<F>(f)));
+    }
+    // 执行完后在工作线程上以返回值调用 done(返回 void 时无参调用)，
+    // 代替 future 的完成回调方式，同样不分配内存
+    template<typename F, typename C>
+    void post(F&& f, C&& done) {
+        submit(Task([fn = forward<F>(f), cb = forward<C>(done)]() mutable {
+            if constexpr (is_void_v<invoke_result_t<decltype(fn)&>>) {
+                fn();
+                cb();
+            } else {
+                cb(fn());
+            }
+        }));
+    }
+    /**
+     * 批量添加任务：整批只加一次队列锁、只做一次唤醒
+     * @param tasks 元素为可调用对象的区间，元素会被移走
+     */
+    template<typename Range>
+    void addTasks(Range&& tasks) {
+        auto [lock, queue] = submitQueue();
+        long count = 0;
         {
-            lock_guard<mutex> locker(m_queueMutex);
-            m_tasks.emplace([mytask]() mutable { (*mytask)(); });
+            lock_guard<mutex> locker(*lock);
+            for (auto&& f : tasks) {
+                queue->emplace_back(std::move(f));
+                ++count;
+            }
+            // 持锁时计数，取走这批任务的线程不会看到负的 m_pending
+            m_pending.fetch_add(count);
+        }
+        if (count > 0) {
+            wakeOrSpawn(count);
+        }
+    }
+    /**
+     * 注册调度类，同名的类已存在时直接返回它的 id
+     * @param priority 优先级，越大越先执行；大于 0 时优先于普通任务
+     * @param maxConcurrency 最多同时执行的任务数，0 表示不限
+     * @param maxQueue 最多排队的任务数，0 表示不限
+     */
+    ClassId addClass(const string& name, int priority, int maxConcurrency = 0,
+                     size_t maxQueue = 0);
+    // 按名字查找调度类，不存在时返回 kDefaultClass
+    ClassId findClass(const string& name) const;
+    ClassStats classStats(ClassId cls) const;
+    vector<ClassStats> allClassStats(void) const;
+
+    // 提交到指定调度类，类的队列已满时抛出 runtime_error
+    template<typename F, typename... Args>
+    auto addTaskTo(ClassId cls, F&& f, Args&&... args)->future<invoke_result_t<F, Args...>> {
+        using returnType = invoke_result_t<F, Args...>;
+        promise<returnType> prom;
+        future<returnType> res = prom.get_future();
+        Task task([prom = std::move(prom), fn = forward<F>(f),
+                   params = make_tuple(forward<Args>(args)...)]() mutable {
+            try {
+                if constexpr (is_void_v<returnType>) {
+                    apply(fn, std::move(params));
+                    prom.set_value();
+                } else {
+                    prom.set_value(apply(fn, std::move(params)));
+                }
+            } catch (...) {
+                prom.set_exception(current_exception());
+            }
+        });
+        if (!submitTo(cls, std::move(task))) {
+            throw runtime_error("thread pool class queue full");
         }
-        m_condition.notify_one();
-        // 4. 返回future
         return res;
     }
+    // 提交到指定调度类，不取结果；类的队列已满时返回 false
+    template<typename F>
+    bool postTo(ClassId cls, F&& f) {
+        return submitTo(cls, Task(forward<F>(f)));
+    }
+
+    /**
+     * 延迟执行任务，到期后提交给工作线程
+     * @return TimerId 可用于 cancelTimer
+     */
+    TimerId scheduleAfter(chrono::milliseconds delay, function<void(void)> task);
+    /**
+     * 周期执行任务，首次在一个周期后执行；上一次还没执行完时跳过本次
+     * @return TimerId 可用于 cancelTimer
+     */
+    TimerId scheduleEvery(chrono::milliseconds period, function<void(void)> task);
+    // 取消定时任务，已到期但还没开始执行的那一次也会被跳过
+    bool cancelTimer(TimerId id);
+
+    // 把所有工作线程(包括之后创建的)绑定到 cpus，为空表示不绑定
+    void setCpuAffinity(const vector<int>& cpus);
 private:
-    void manager(void);
-    void worker(void);
+    // 每个工作线程一个，槽位在构造时按最大线程数分配，线程退出后可复用
+    struct WorkerSlot {
+        mutex lock;               // 保护 tasks，只有所有者和窃取者会竞争
+        TaskQueue tasks;          // 本地任务队列
+        thread worker;
+        atomic_bool running{false};
+    };
+
+    // 调度类。类只增不删，存放在固定大小的数组里，工作线程可以不加锁地遍历
+    struct SchedClass {
+        string name;
+        int priority = 0;
+        int maxConcurrency = 0;
+        size_t maxQueue = 0;
+        struct Entry {
+            Task task;
+            chrono::steady_clock::time_point enqueued; // 入队时刻
+        };
+        mutex lock;               // 保护 tasks 和 running
+        RingQueue<Entry> tasks;
+        int running = 0;
+        atomic_long runnable{0};  // 可立即执行的任务数，计入 m_pending
+        atomic<uint64_t> completed{0};
+        atomic<uint64_t> rejected{0};
+        LatencyHistogram waitHist;
+        LatencyHistogram runHist;
+    };
+    static constexpr int kMaxClasses = 32;
+
+    void submit(Task task);
+    bool submitTo(ClassId cls, Task task);
+    bool popClassTask(bool highPriority, Task &task, SchedClass *&cls);
+    long updateRunnable(SchedClass &sc);
+    void finishClassTask(SchedClass &sc);
+    pair<mutex*, TaskQueue*> submitQueue(void);
+    bool popTask(int index, Task &task, SchedClass *&cls);
+    void wakeOrSpawn(long count);
+    void spawnWorker(void);
+    void worker(int index);
 
 private:
-    thread* m_manager;                    // 线程池管理者线程
-    map<thread::id, thread> m_workers;    // 工作线程容器
-    vector<thread::id> m_ids;             // 需要退出的线程ID列表
+    vector<unique_ptr<WorkerSlot>> m_slots; // 工作线程槽位
+    TaskQueue m_global;                   // 全局注入队列
+    mutex m_globalMutex;                  // 全局队列互斥锁
     atomic_int m_minThread;               // 最小线程数
     atomic_int m_maxThread;               // 最大线程数
-    atomic_int m_idleThread;              // 空闲线程数
-    atomic_int m_curThread;               // 当前活跃线程数
-    atomic_int m_exitThread;              // 需要销毁的线程数
+    atomic_int m_idleThread;              // 睡眠中的线程数
+    atomic_int m_wakeups;                 // 已唤醒但尚未醒来的线程数
+    atomic_int m_curThread;               // 当前线程数
+    atomic_long m_pending;                // 所有队列中可立即执行的任务数
     atomic_bool m_stop;                   // 线程池停止标志
-    queue<function<void(void)>> m_tasks;  // 任务队列
-    mutex m_queueMutex;                   // 任务队列互斥锁
-    mutex m_idsMutex;                     // 线程ID列表互斥锁
+    mutex m_parkMutex;                    // 睡眠/唤醒互斥锁
+    mutex m_spawnMutex;                   // 创建/回收线程互斥锁
     condition_variable m_condition;       // 条件变量
+    unique_ptr<TimerWheel> m_timers;      // 延迟/周期任务的时间轮
+    unique_ptr<SchedClass> m_classes[kMaxClasses + 1]; // 下标即 ClassId，0 不用
+    atomic_int m_classCount{0};           // 已注册的调度类数
+    mutex m_classMutex;                   // 串行化调度类注册
+    vector<int> m_cpus;                   // 工作线程绑定的 CPU，受 m_spawnMutex 保护
 
 
 };
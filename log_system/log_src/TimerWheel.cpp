@@ -0,0 +1,196 @@
+#include "TimerWheel.hpp"
+#include <algorithm>
+#include <utility>
+
+TimerWheel::TimerWheel(function<void(PoolTask)> dispatch)
+    : m_dispatch(std::move(dispatch)), m_start(chrono::steady_clock::now()) {}
+
+TimerWheel::~TimerWheel() {
+    {
+        lock_guard<mutex> locker(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    // 未到期的定时器直接丢弃，节点随 m_timers 释放
+    for (auto& level : m_slots) {
+        for (auto& slot : level) {
+            while (slot.linked()) {
+                slot.next->unlink();
+            }
+        }
+    }
+}
+
+TimerWheel::TimerId TimerWheel::add(chrono::milliseconds delay,
+                                    chrono::milliseconds period, Callback cb) {
+    auto node = make_shared<Node>();
+    node->cb = std::move(cb);
+    node->period =
+        period.count() > 0 ? static_cast<uint64_t>(period.count()) : 0;
+    bool wake = false;
+    TimerId id;
+    {
+        lock_guard<mutex> locker(m_mutex);
+        if (!m_thread.joinable()) {
+            m_thread = thread(&TimerWheel::loop, this);
+        }
+        // 没有定时器时定时线程不推进，直接跳到当前时刻，省去醒来后逐格追赶
+        if (m_timers.empty()) {
+            m_current = max(m_current, nowTick());
+        }
+        id = m_nextId++;
+        node->id = id;
+        // nowTick 向下取整，多加一格保证不会比要求的延迟更早触发
+        const auto ticks = static_cast<uint64_t>(max<int64_t>(delay.count(), 0));
+        node->expire = max(nowTick(), m_current) + ticks + 1;
+        insert(node.get());
+        m_timers.emplace(id, std::move(node));
+        // 比定时线程计划的醒来时间更早到期时叫醒它重新计算
+        wake = m_timers.at(id)->expire < m_wakeTick;
+    }
+    if (wake) {
+        m_condition.notify_one();
+    }
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    lock_guard<mutex> locker(m_mutex);
+    auto it = m_timers.find(id);
+    if (it == m_timers.end()) {
+        return false;
+    }
+    it->second->cancelled.store(true);
+    it->second->unlink();
+    m_timers.erase(it);
+    return true;
+}
+
+size_t TimerWheel::size(void) {
+    lock_guard<mutex> locker(m_mutex);
+    return m_timers.size();
+}
+
+uint64_t TimerWheel::nowTick(void) const {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(
+                                     chrono::steady_clock::now() - m_start)
+                                     .count());
+}
+
+void TimerWheel::insert(Node* node) {
+    // 按距到期的格数选层：第 n 层覆盖 [256^n, 256^(n+1)) 格
+    const uint64_t expire = max(node->expire, m_current);
+    const uint64_t delta = min(expire - m_current, kMaxDelta);
+    const uint64_t target = m_current + delta;
+    int level = 0;
+    while (level < kLevels - 1 &&
+           delta >= (uint64_t(1) << ((level + 1) * kSlotBits))) {
+        ++level;
+    }
+    Hook& slot = m_slots[level][(target >> (level * kSlotBits)) & (kSlots - 1)];
+    node->prev = slot.prev;
+    node->next = &slot;
+    slot.prev->next = node;
+    slot.prev = node;
+}
+
+void TimerWheel::cascade(int level, uint64_t index) {
+    // 先把整条链摘下来再逐个重新放置，重新放置可能落回同一个槽
+    Hook list;
+    Hook& slot = m_slots[level][index];
+    if (!slot.linked()) {
+        return;
+    }
+    list.next = slot.next;
+    list.prev = slot.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    slot.prev = slot.next = &slot;
+    while (list.linked()) {
+        Node* node = static_cast<Node*>(list.next);
+        node->unlink();
+        insert(node);
+    }
+}
+
+void TimerWheel::advance(vector<shared_ptr<Node>>& due) {
+    ++m_current;
+    // 低层每转完一圈，把上一层对应槽降级；从高层往低层做，一次降到底
+    for (int level = kLevels - 1; level >= 1; --level) {
+        const uint64_t mask = (uint64_t(1) << (level * kSlotBits)) - 1;
+        if ((m_current & mask) == 0) {
+            cascade(level, (m_current >> (level * kSlotBits)) & (kSlots - 1));
+        }
+    }
+
+    Hook& slot = m_slots[0][m_current & (kSlots - 1)];
+    while (slot.linked()) {
+        Node* node = static_cast<Node*>(slot.next);
+        node->unlink();
+        auto it = m_timers.find(node->id);
+        due.push_back(it->second);
+        if (node->period > 0) {
+            // 固定频率：下一次以本次应到期的时间为基准，不累积延迟；
+            // 定时线程落后太多时跳过错过的周期，不连续补发
+            node->expire += node->period;
+            if (node->expire <= m_current) {
+                node->expire = m_current + node->period;
+            }
+            insert(node);
+        } else {
+            m_timers.erase(it);
+        }
+    }
+}
+
+uint64_t TimerWheel::nextWakeTick(void) const {
+    // 最底层一圈内有定时器就醒在那一格，否则醒在下一次降级
+    for (uint64_t tick = m_current + 1; tick <= m_current + kSlots; ++tick) {
+        if ((tick & (kSlots - 1)) == 0) {
+            return tick;
+        }
+        if (m_slots[0][tick & (kSlots - 1)].linked()) {
+            return tick;
+        }
+    }
+    return m_current + kSlots;
+}
+
+void TimerWheel::loop(void) {
+    vector<shared_ptr<Node>> due;
+    unique_lock<mutex> locker(m_mutex);
+    while (!m_stop) {
+        if (m_timers.empty()) {
+            m_wakeTick = UINT64_MAX;
+            m_condition.wait(locker);
+            continue;
+        }
+        const uint64_t now = nowTick();
+        while (m_current < now) {
+            advance(due);
+        }
+        if (!due.empty()) {
+            // 投递时不持锁，回调里可以再添加或取消定时器
+            locker.unlock();
+            for (auto& node : due) {
+                m_dispatch(PoolTask([node = std::move(node)]() {
+                    if (node->cancelled.load() ||
+                        node->running.exchange(true)) {
+                        return;
+                    }
+                    node->cb();
+                    node->running.store(false);
+                }));
+            }
+            due.clear();
+            locker.lock();
+            continue;
+        }
+        m_wakeTick = nextWakeTick();
+        m_condition.wait_until(locker,
+                               m_start + chrono::milliseconds(m_wakeTick));
+    }
+}
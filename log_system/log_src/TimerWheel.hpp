@@ -0,0 +1,91 @@
+
+
+#ifndef ASYNCLOG_CLOUDSTORAGE_TIMERWHEEL_HPP
+#define ASYNCLOG_CLOUDSTORAGE_TIMERWHEEL_HPP
+
+#include "ThreadPool.hpp"
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * 分层时间轮
+ *
+ * 4 层、每层 256 个槽，最底层一格为 1ms，可以表示约 49 天内的定时；更远的
+ * 定时先挂在最高层，降级时按真实到期时间重新放置。插入和取消都是 O(1)：
+ * 按距到期的格数直接算出层和槽，挂到槽的双向链表上；取消时按 id 找到节点
+ * 摘链。只有当低层转完一圈时才把上一层对应槽的定时器降级到下层。
+ *
+ * 由一个定时线程推进时间轮，到期的回调交给 dispatch 投递(线程池中即
+ * 提交给工作线程执行)，定时线程本身不执行回调。没有定时器时线程一直睡眠，
+ * 最底层一圈内没有到期的定时器时直接睡到下一次降级。
+ */
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    using Callback = function<void(void)>;
+
+    explicit TimerWheel(function<void(PoolTask)> dispatch);
+    ~TimerWheel();
+
+    /**
+     * 添加定时器
+     * @param delay 首次触发前的延迟
+     * @param period 触发周期，为 0 表示只触发一次
+     * @return TimerId 用于取消的 id，从 1 开始
+     */
+    TimerId add(chrono::milliseconds delay, chrono::milliseconds period,
+                Callback cb);
+    // 取消定时器，已经投递但尚未开始执行的那一次也不再执行
+    bool cancel(TimerId id);
+    size_t size(void);
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 8;
+    static constexpr uint64_t kSlots = 1 << kSlotBits;
+    static constexpr uint64_t kMaxDelta =
+        (uint64_t(1) << (kLevels * kSlotBits)) - 1;
+
+    // 槽链表的挂钩，槽头是不带数据的哨兵
+    struct Hook {
+        Hook* prev = this;
+        Hook* next = this;
+        void unlink(void) {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+        bool linked(void) const { return next != this; }
+    };
+    struct Node : Hook {
+        TimerId id = 0;
+        uint64_t expire = 0;        // 到期的时间格
+        uint64_t period = 0;        // 周期(格)，0 表示单次
+        Callback cb;
+        atomic_bool cancelled{false};
+        atomic_bool running{false}; // 周期回调还在执行时跳过这一次
+    };
+
+    uint64_t nowTick(void) const;
+    void insert(Node* node);
+    void cascade(int level, uint64_t index);
+    void advance(vector<shared_ptr<Node>>& due);
+    uint64_t nextWakeTick(void) const;
+    void loop(void);
+
+private:
+    function<void(PoolTask)> m_dispatch;          // 投递到期回调
+    chrono::steady_clock::time_point m_start;     // 第 0 格对应的时刻
+    uint64_t m_current = 0;                       // 已处理到的时间格
+    uint64_t m_wakeTick = UINT64_MAX;             // 定时线程计划醒来的时间格
+    TimerId m_nextId = 1;
+    Hook m_slots[kLevels][kSlots];
+    unordered_map<TimerId, shared_ptr<Node>> m_timers; // 所有未到期/周期定时器
+    bool m_stop = false;
+    mutex m_mutex;
+    condition_variable m_condition;
+    thread m_thread;                              // 第一次添加定时器时启动
+};
+
+#endif // ASYNCLOG_CLOUDSTORAGE_TIMERWHEEL_HPP
@@ -9,6 +9,16 @@
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <vector>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#include "Level.hpp"
 #ifndef ASYNCLOG_CLOUDSTORAGE_UTIL_HPP
 #define ASYNCLOG_CLOUDSTORAGE_UTIL_HPP
 
@@ -124,41 +134,208 @@ class JsonUtil {
     }
 };
 
+/**
+ * @brief 日志系统配置
+ *
+ * 每次加载生成一份不可变的快照，通过原子指针发布，GetJsonData 只是一次
+ * 原子读。旧快照不释放(配置很少变化)，调用方拿到的指针始终有效，不需要
+ * 引用计数。配置文件路径依次取 Load 的参数、环境变量 MYLOG_CONFIG、
+ * 默认的 ../log_system/log_src/config.conf；config_watch 为 1 时用
+ * inotify 监视配置文件所在目录，文件被改写或替换后自动重新加载，解析
+ * 失败时保留旧快照。
+ */
 struct LogConfig {
-    static LogConfig *GetJsonData() {
-        static auto *json_data = new LogConfig;
-        return json_data;
+    static const LogConfig *GetJsonData() {
+        const LogConfig *conf = Store().current.load(std::memory_order_acquire);
+        if (conf == nullptr) {
+            // 第一次使用时按默认路径加载
+            std::unique_lock<std::mutex> lock(Store().mutex);
+            conf = Store().current.load(std::memory_order_acquire);
+            if (conf == nullptr) {
+                const char *env = getenv("MYLOG_CONFIG");
+                LoadLocked(env ? env : "../log_system/log_src/config.conf",
+                           true);
+                conf = Store().current.load(std::memory_order_acquire);
+            }
+        }
+        return conf;
     }
 
+    /**
+     * @brief 从 path 加载配置并发布新快照，之后的重新加载也使用该路径
+     * @note 只影响之后读取配置的地方，线程数、CPU 绑定等启动时读取的配置
+     *       仍需重启才生效
+     */
+    static bool Load(const std::string &path) {
+        std::unique_lock<std::mutex> lock(Store().mutex);
+        return LoadLocked(path, Store().current.load() == nullptr);
+    }
+    // 按当前路径重新加载
+    static bool Reload() {
+        std::unique_lock<std::mutex> lock(Store().mutex);
+        return LoadLocked(Store().path, false);
+    }
   private:
-    LogConfig() {
+    struct Snapshots {
+        std::atomic<const LogConfig *> current{nullptr};
+        std::mutex mutex; // 串行化加载
+        std::vector<std::unique_ptr<const LogConfig>> all;
+        std::string path;
+        std::string watching; // 监视线程正在监视的路径
+    };
+    // 与 LogConfig 一样不析构：静态析构阶段仍可能有日志写入
+    static Snapshots &Store() {
+        static auto *store = new Snapshots;
+        return *store;
+    }
+
+    /**
+     * @brief 读取并发布新快照，调用方持有 Store().mutex
+     * @param initial 还没有任何快照：读取失败也发布一份默认值
+     */
+    static bool LoadLocked(const std::string &path, const bool initial) {
+        Snapshots &store = Store();
+        store.path = path;
         std::string content;
-        if (File::GetContent(&content,
-                             "../log_system/log_src/config.conf") == false) {
+        Json::Value root;
+        if (File::GetContent(&content, path) == false) {
             std::cout << __FILE__ << __LINE__ << "open config.conf failed"
                       << std::endl;
             perror(nullptr);
+            if (!initial)
+                return false;
+        } else if (!JsonUtil::UnSerialize(content, &root) && !initial) {
+            // 编辑器写了一半或写错时保留旧配置
+            return false;
         }
-        Json::Value root;
-        JsonUtil::UnSerialize(content,
-                              &root); // 反序列化，把内容转成 json value格式
+        auto conf = std::unique_ptr<LogConfig>(new LogConfig(root));
+        conf->generation = store.all.size() + 1;
+        store.current.store(conf.get(), std::memory_order_release);
+        store.all.emplace_back(std::move(conf));
+        if (!initial)
+            std::cout << "[mylog] config reloaded: " << path << std::endl;
+        if (store.current.load()->config_watch && store.watching != path) {
+            store.watching = path;
+            std::thread(&LogConfig::WatchLoop, path).detach();
+        }
+        return true;
+    }
+
+    /**
+     * @brief 监视线程：监视配置文件所在目录，编辑器通常写临时文件再改名，
+     *        只监视文件本身会在替换后丢失
+     */
+    static void WatchLoop(const std::string path) {
+        const int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0) {
+            perror("inotify_init1");
+            return;
+        }
+        const fs::path file(path);
+        const std::string dir =
+            file.has_parent_path() ? file.parent_path().string() : ".";
+        const std::string name = file.filename().string();
+        if (inotify_add_watch(fd, dir.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            perror("inotify_add_watch");
+            close(fd);
+            return;
+        }
+        alignas(inotify_event) char buf[4096];
+        while (true) {
+            const ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                break;
+            }
+            bool changed = false;
+            for (ssize_t off = 0; off < n;) {
+                const auto *ev = reinterpret_cast<const inotify_event *>(buf + off);
+                if (ev->len > 0 && name == ev->name)
+                    changed = true;
+                off += sizeof(inotify_event) + ev->len;
+            }
+            {
+                // 已经换了配置文件，由新的监视线程负责
+                std::unique_lock<std::mutex> lock(Store().mutex);
+                if (Store().watching != path)
+                    break;
+            }
+            if (changed)
+                Reload();
+        }
+        close(fd);
+    }
+
+    explicit LogConfig(const Json::Value &root) {
         buffer_size = root["buffer_size"].asInt64();
         threshold = root["threshold"].asInt64();
         linear_growth = root["linear_growth"].asInt64();
         flush_log = root["flush_log"].asInt64();
+        flush_interval_ms = root.get("flush_interval_ms", 1000).asInt64();
         backup_addr = root["backup_addr"].asString();
         backup_port = root["backup_port"].asInt();
         thread_count = root["thread_count"].asInt();
+        backend_threads = root.get("backend_threads", 0).asInt();
+        buffer_idle_ms = root.get("buffer_idle_ms", 30000).asInt64();
+        buffer_hugepage = root.get("buffer_hugepage", 0).asInt();
+        worker_spin_count = root.get("worker_spin_count", 0).asInt64();
+        batch_min_bytes = root.get("batch_min_bytes", 0).asInt64();
+        batch_max_delay_us = root.get("batch_max_delay_us", 0).asInt64();
+        sink_backlog_bytes = root.get("sink_backlog_bytes", 0).asInt64();
+        crash_ring_dir = root.get("crash_ring_dir", "").asString();
+        crash_ring_bytes = root.get("crash_ring_bytes", 4194304).asInt64();
+        log_clock = root.get("log_clock", "realtime").asString();
+        worker_cpus = root.get("worker_cpus", "").asString();
+        pool_cpus = root.get("pool_cpus", "").asString();
+        fatal_flush_ms = root.get("fatal_flush_ms", 1000).asUInt64();
+        log_level = LogLevel::FromString(root.get("log_level", "DEBUG").asString());
+        config_watch = root.get("config_watch", 0).asBool();
+        for (const auto &cls : root["thread_classes"]) {
+            ThreadClass tc;
+            tc.name = cls["name"].asString();
+            tc.priority = cls.get("priority", 0).asInt();
+            tc.max_concurrency = cls.get("max_concurrency", 0).asInt();
+            tc.max_queue = cls.get("max_queue", 0).asInt64();
+            thread_classes.push_back(tc);
+        }
     }
 
   public:
+    // 线程池调度类，见 ThreadPool::addClass
+    struct ThreadClass {
+        std::string name;
+        int priority;        // 大于 0 时优先于普通任务
+        int max_concurrency; // 最多同时执行的任务数，0 表示不限
+        size_t max_queue;    // 最多排队的任务数，0 表示不限
+    };
+
     size_t buffer_size;   // 缓冲区基础容量
     size_t threshold;     // 倍数扩容阈值
     size_t linear_growth; // 线性增长容量
     size_t flush_log; // 控制日志同步到磁盘的时机，默认为 0,1 调用 fflush，2 调用fsync
+    size_t flush_interval_ms; // flush_log 为 0 时定时刷盘的间隔(毫秒)，0 表示不定时刷盘
     std::string backup_addr;
     uint16_t backup_port;
     size_t thread_count;
+    size_t backend_threads; // 共享刷盘线程数，0 表示每个日志器独占一个工作线程
+    size_t buffer_idle_ms;  // 缓冲区空闲多久(毫秒)后释放内存
+    int buffer_hugepage; // 缓冲区大页模式：0 普通页，1 透明大页，2 显式大页
+    size_t worker_spin_count;  // 消费者睡眠前的自旋次数
+    size_t batch_min_bytes;    // 消费者攒批的最小字节数，0 表示有数据就处理
+    size_t batch_max_delay_us; // 攒批最多等待的微秒数
+    size_t sink_backlog_bytes; // 多输出方向并行写时每个方向的积压上限，0 表示串行写
+    std::string crash_ring_dir; // 崩溃保护环形日志所在目录，为空表示不启用
+    size_t crash_ring_bytes;    // 每个日志器环形日志的容量
+    std::string log_clock; // 日志时间戳时钟：coarse / realtime / tsc
+    std::string worker_cpus; // 日志工作线程/共享刷盘线程绑定的 CPU 列表，空表示不绑定
+    std::string pool_cpus;   // 线程池工作线程绑定的 CPU 列表，空表示不绑定
+    size_t fatal_flush_ms; // FATAL 日志写入后等待落盘的最长时间，0 表示不等待
+    std::vector<ThreadClass> thread_classes; // 线程池调度类
+    LogLevel::value log_level; // 低于该级别的日志直接丢弃
+    bool config_watch;         // 是否监视配置文件并自动重新加载
+    size_t generation = 0;     // 快照序号
 };
 
 } // namespace mylog::util
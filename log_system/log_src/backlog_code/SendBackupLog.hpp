@@ -22,8 +22,10 @@ void send_backlog(const std::string& message) {
     sockaddr_in server{};
     memset(&server, 0, sizeof(server));
     server.sin_family = AF_INET;
-    server.sin_port = htons(mylog::util::LogConfig::GetJsonData()->backup_port);
-    server.sin_addr.s_addr = inet_addr(mylog::util::LogConfig::GetJsonData()->backup_addr.c_str());
+    // 备份目标可能被热加载修改，端口和地址取自同一份配置快照
+    const auto *conf = mylog::util::LogConfig::GetJsonData();
+    server.sin_port = htons(conf->backup_port);
+    server.sin_addr.s_addr = inet_addr(conf->backup_addr.c_str());
     int cnt = 5;
     while (-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&server), sizeof(server)))
     {
@@ -0,0 +1,313 @@
+// HTTP 服务端压测
+//
+// --connections 个长连接各占一个线程，在 --seconds 秒内循环对 --url 发 GET，
+// 统计每秒请求数和单次请求延迟的 p50/p99/p99.9/max，结果以 JSON 输出。
+// 用来比较不同 event_loop_threads 下吞吐量能否随核数增长。
+// --uploaders 个连接同时在后台反复上传 --upload-bytes 字节的深度存储文件，
+// 每个连接限速 --upload-rate MB/s(0 不限速)，用来观察大上传进行时小请求
+// 的延迟是否受影响；比较不同版本时限速保证上传负载相同。
+//
+// 用法(先启动服务端)：
+//   ./HttpBench --url / [--host 127.0.0.1] [--port 8081] [--connections 8]
+//               [--seconds 10] [--uploaders 0] [--upload-bytes 33554432]
+//               [--upload-rate 0] [--out result.json]
+#include "../../log_system/log_src/Util.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    std::string url;
+    int connections = 8;
+    int seconds = 10;
+    int uploaders = 0;
+    uint64_t upload_bytes = 32 << 20;
+    double upload_rate = 0; // 每个上传连接的 MB/s，0 不限速
+    std::string out;
+};
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--host") {
+                opt->host = value;
+            } else if (key == "--port") {
+                opt->port = std::stoi(value);
+            } else if (key == "--url") {
+                opt->url = value;
+            } else if (key == "--connections") {
+                opt->connections = std::stoi(value);
+            } else if (key == "--seconds") {
+                opt->seconds = std::stoi(value);
+            } else if (key == "--uploaders") {
+                opt->uploaders = std::stoi(value);
+            } else if (key == "--upload-bytes") {
+                opt->upload_bytes = std::stoull(value);
+            } else if (key == "--upload-rate") {
+                opt->upload_rate = std::stod(value);
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (opt->url.empty() || opt->connections <= 0) {
+        std::cerr << "--url is required" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int Connect(const Options &opt) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/**
+ * @brief 在长连接上收一个完整回复，只认 Content-Length 定长的回复
+ * @param pending 上次多读到的字节，返回时保存本次多读的部分
+ */
+bool ReadReply(const int fd, std::string *pending, int *status) {
+    std::string &buf = *pending;
+    char chunk[64 * 1024];
+    size_t head_end;
+    while ((head_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return false;
+        buf.append(chunk, n);
+    }
+    *status = 0;
+    sscanf(buf.c_str(), "HTTP/%*s %d", status);
+    uint64_t length = 0;
+    for (size_t pos = buf.find("\r\n"); pos < head_end;
+         pos = buf.find("\r\n", pos + 2)) {
+        if (strncasecmp(buf.c_str() + pos + 2, "Content-Length:", 15) == 0)
+            length = std::stoull(buf.substr(pos + 17));
+    }
+    buf.erase(0, head_end + 4);
+    // 正文只计数不保存
+    while (buf.size() < length) {
+        length -= buf.size();
+        buf.clear();
+        const ssize_t n = recv(fd, chunk, std::min<uint64_t>(sizeof(chunk),
+                                                             length), 0);
+        if (n <= 0)
+            return false;
+        buf.append(chunk, n);
+    }
+    buf.erase(0, length);
+    return true;
+}
+
+// FileName 头是 base64 编码的文件名
+std::string Base64(const std::string &in) {
+    static const char kTable[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < in.size(); i += 3) {
+        uint32_t v = static_cast<unsigned char>(in[i]) << 16;
+        if (i + 1 < in.size())
+            v |= static_cast<unsigned char>(in[i + 1]) << 8;
+        if (i + 2 < in.size())
+            v |= static_cast<unsigned char>(in[i + 2]);
+        out += kTable[(v >> 18) & 63];
+        out += kTable[(v >> 12) & 63];
+        out += i + 1 < in.size() ? kTable[(v >> 6) & 63] : '=';
+        out += i + 2 < in.size() ? kTable[v & 63] : '=';
+    }
+    return out;
+}
+
+// 在一个长连接上反复上传同一个文件，直到 stop，返回完成的上传数
+uint64_t UploadLoop(const Options &opt, const int id,
+                    const std::atomic<bool> &stop) {
+    const std::string head =
+        "POST /upload HTTP/1.1\r\nHost: " + opt.host +
+        "\r\nFileName: " + Base64("httpbench_" + std::to_string(id) + ".bin") +
+        "\r\nStorageType: deep\r\nContent-Length: " +
+        std::to_string(opt.upload_bytes) + "\r\n\r\n";
+    std::vector<char> body(1 << 20);
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = static_cast<char>(i * 2654435761u >> 13);
+    uint64_t done = 0;
+    int fd = -1;
+    std::string pending;
+    const auto start = Clock::now();
+    uint64_t total = 0; // 已发送的请求体字节，用于限速
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (fd < 0 && (fd = Connect(opt)) < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        bool ok = send(fd, head.data(), head.size(), MSG_NOSIGNAL) ==
+                  static_cast<ssize_t>(head.size());
+        for (uint64_t left = opt.upload_bytes; ok && left > 0;) {
+            const size_t n = std::min<uint64_t>(left, body.size());
+            const ssize_t sent = send(fd, body.data(), n, MSG_NOSIGNAL);
+            ok = sent > 0;
+            left -= ok ? sent : 0;
+            total += ok ? sent : 0;
+            if (opt.upload_rate > 0)
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(
+                                    total / (opt.upload_rate * 1024 * 1024))));
+        }
+        int status = 0;
+        if (ok && ReadReply(fd, &pending, &status) && status == 200) {
+            done++;
+            continue;
+        }
+        close(fd);
+        fd = -1;
+        pending.clear();
+    }
+    if (fd >= 0)
+        close(fd);
+    return done;
+}
+
+double Percentile(const std::vector<uint32_t> &sorted, const double p) {
+    if (sorted.empty())
+        return 0;
+    const size_t idx = std::min(sorted.size() - 1,
+                                static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    const std::string request = "GET " + opt.url + " HTTP/1.1\r\nHost: " +
+                                opt.host + "\r\n\r\n";
+
+    std::vector<std::vector<uint32_t>> latencies(opt.connections);
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> non_2xx{0};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> uploads{0};
+    std::vector<std::thread> threads;
+    for (int u = 0; u < opt.uploaders; ++u)
+        threads.emplace_back([&, u]() { uploads += UploadLoop(opt, u, stop); });
+    const auto start = Clock::now();
+    for (int t = 0; t < opt.connections; ++t) {
+        threads.emplace_back([&, t]() {
+            auto &lat = latencies[t];
+            lat.reserve(1 << 16);
+            int fd = -1;
+            std::string pending;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (fd < 0 && (fd = Connect(opt)) < 0) {
+                    errors++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+                const auto begin = Clock::now();
+                int status = 0;
+                if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+                        static_cast<ssize_t>(request.size()) ||
+                    !ReadReply(fd, &pending, &status)) {
+                    errors++;
+                    close(fd);
+                    fd = -1;
+                    pending.clear();
+                    continue;
+                }
+                lat.push_back(static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - begin)
+                        .count()));
+                if (status < 200 || status >= 300)
+                    non_2xx++;
+            }
+            if (fd >= 0)
+                close(fd);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    stop.store(true);
+    for (auto &thread : threads)
+        thread.join();
+    const double elapsed =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint32_t> all;
+    for (const auto &lat : latencies)
+        all.insert(all.end(), lat.begin(), lat.end());
+    std::sort(all.begin(), all.end());
+
+    Json::Value root;
+    root["url"] = opt.url;
+    root["connections"] = opt.connections;
+    root["seconds"] = elapsed;
+    root["requests"] = static_cast<Json::UInt64>(all.size());
+    root["requests_per_sec"] = all.size() / elapsed;
+    root["errors"] = static_cast<Json::UInt64>(errors.load());
+    root["non_2xx"] = static_cast<Json::UInt64>(non_2xx.load());
+    root["uploaders"] = opt.uploaders;
+    root["upload_bytes"] = static_cast<Json::UInt64>(opt.upload_bytes);
+    root["upload_rate"] = opt.upload_rate;
+    root["uploads"] = static_cast<Json::UInt64>(uploads.load());
+    Json::Value latency;
+    latency["p50"] = Percentile(all, 0.5);
+    latency["p99"] = Percentile(all, 0.99);
+    latency["p999"] = Percentile(all, 0.999);
+    latency["max"] = all.empty() ? 0.0 : static_cast<double>(all.back());
+    root["latency_us"] = latency;
+    std::cerr << opt.url << ": " << static_cast<int64_t>(all.size() / elapsed)
+              << " req/s, p99 " << latency["p99"].asDouble() << " us"
+              << std::endl;
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    return 0;
+}
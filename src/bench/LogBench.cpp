@@ -0,0 +1,241 @@
+// 日志系统基准测试
+//
+// 对每种 AsyncType x 输出方向 x 消息大小 x 生产者线程数的组合分别测量：
+//   - 生产者提交吞吐量，以及单次调用延迟的 p50/p99/p99.9/max
+//   - 端到端排空时间：从第一条提交到最后一条被输出方向写完并同步，
+//     由 AsyncLogger::Flush 屏障等待，不靠 sleep 估计
+// 结果以 JSON 输出，便于不同版本之间比较回归。stdout 输出方向测量时进程的
+// 标准输出被重定向到 /dev/null(测的是日志器和 iostream 的开销，不含终端)，
+// 没有 --out 时结果写到原来的标准输出。
+//
+// 用法(在 build 目录下运行，配置文件按 ../log_system/log_src/config.conf 查找)：
+//   ./LogBench [--messages N] [--producers 1,4] [--sizes 16,64,256,1024,4096]
+//              [--sinks null,stdout,file,rollfile] [--types safe,unsafe]
+//              [--out result.json]
+#include "../../log_system/log_src/MyLog.hpp"
+#include "../../log_system/log_src/ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+ThreadPool *tp = nullptr;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// null：丢弃数据，测日志器本身的开销
+class NullFlush final : public mylog::LogFlush {
+  public:
+    void Flush(const char *, const size_t) override {}
+};
+
+struct Options {
+    size_t messages = 100000; // 每个生产者线程提交的条数
+    std::vector<int> producers = {1, 4};
+    std::vector<int> sizes = {16, 64, 256, 1024, 4096};
+    std::vector<std::string> sinks = {"null", "stdout", "file", "rollfile"};
+    std::vector<std::string> types = {"safe", "unsafe"};
+    std::string out;
+};
+
+std::vector<std::string> SplitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--messages") {
+                opt->messages = std::stoul(value);
+            } else if (key == "--producers" || key == "--sizes") {
+                auto &dst = key == "--producers" ? opt->producers : opt->sizes;
+                dst.clear();
+                for (const auto &item : SplitList(value))
+                    dst.push_back(std::stoi(item));
+            } else if (key == "--sinks") {
+                opt->sinks = SplitList(value);
+            } else if (key == "--types") {
+                opt->types = SplitList(value);
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+mylog::LogFlush::ptr CreateSink(const std::string &sink,
+                                const std::string &name) {
+    const std::string path = "./bench_logs/" + name + ".log";
+    if (sink == "file")
+        return LogFlushFactory::CreateLogFlush<mylog::FileFlush>(path);
+    if (sink == "rollfile")
+        return LogFlushFactory::CreateLogFlush<mylog::RollFileFlush>(
+            path, 64 * 1024 * 1024);
+    if (sink == "stdout")
+        return LogFlushFactory::CreateLogFlush<mylog::StdoutFlush>();
+    return std::make_shared<NullFlush>();
+}
+
+double Percentile(const std::vector<uint32_t> &sorted, const double p) {
+    if (sorted.empty())
+        return 0;
+    const size_t idx = std::min(sorted.size() - 1,
+                                static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+
+Json::Value RunCase(const Options &opt, const std::string &type,
+                    const std::string &sink, const int size,
+                    const int producers) {
+    const std::string name = "bench_" + type + "_" + sink + "_" +
+                             std::to_string(size) + "_" +
+                             std::to_string(producers);
+    auto logger = std::make_shared<mylog::AsyncLogger>(
+        name, std::vector<mylog::LogFlush::ptr>{CreateSink(sink, name)},
+        type == "unsafe" ? mylog::AsyncType::ASYNC_UNSAFE
+                         : mylog::AsyncType::ASYNC_SAFE);
+    const std::string payload(size, 'x');
+
+    // 每个线程预先分配延迟数组，计时循环内不分配内存
+    std::vector<std::vector<uint32_t>> latencies(producers);
+    for (auto &lat : latencies)
+        lat.resize(opt.messages);
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; ++t) {
+        threads.emplace_back([&, t]() {
+            auto &lat = latencies[t];
+            ready++;
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (size_t i = 0; i < opt.messages; ++i) {
+                const auto begin = Clock::now();
+                logger->Info("%s", payload.c_str());
+                lat[i] = static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - begin)
+                        .count());
+            }
+        });
+    }
+    while (ready.load() < producers)
+        std::this_thread::yield();
+    const auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &thread : threads)
+        thread.join();
+    const auto submitted = Clock::now();
+    const size_t total = opt.messages * producers;
+    const bool drained = logger->Flush(std::chrono::seconds(120));
+    const auto end = Clock::now();
+
+    std::vector<uint32_t> all;
+    all.reserve(total);
+    for (const auto &lat : latencies)
+        all.insert(all.end(), lat.begin(), lat.end());
+    std::sort(all.begin(), all.end());
+
+    const double submit_s =
+        std::chrono::duration<double>(submitted - start).count();
+    const double drain_s = std::chrono::duration<double>(end - start).count();
+    Json::Value result;
+    result["async_type"] = type;
+    result["sink"] = sink;
+    result["message_bytes"] = size;
+    result["producers"] = producers;
+    result["messages"] = static_cast<Json::UInt64>(total);
+    result["submit_msgs_per_sec"] = total / submit_s;
+    result["submit_mb_per_sec"] = total * size / submit_s / (1024 * 1024);
+    result["end_to_end_msgs_per_sec"] = total / drain_s;
+    result["drain_ms"] = drain_s * 1000;
+    result["drained"] = drained;
+    Json::Value latency;
+    latency["p50"] = Percentile(all, 0.5);
+    latency["p99"] = Percentile(all, 0.99);
+    latency["p999"] = Percentile(all, 0.999);
+    latency["max"] = all.empty() ? 0.0 : static_cast<double>(all.back());
+    result["latency_ns"] = latency;
+    std::cerr << name << ": " << static_cast<int64_t>(total / submit_s)
+              << " msgs/s, p99 " << latency["p99"].asDouble() << " ns, drain "
+              << static_cast<int64_t>(drain_s * 1000) << " ms" << std::endl;
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    // stdout 输出方向写进 /dev/null，结果写到原来的标准输出，保持是合法的 JSON
+    std::cout.flush();
+    const int result_fd = dup(STDOUT_FILENO);
+    const int devnull = open("/dev/null", O_WRONLY);
+    if (result_fd < 0 || devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0) {
+        std::cerr << "redirect stdout failed" << std::endl;
+        return 1;
+    }
+    close(devnull);
+
+    // ERROR/FATAL 的远程备份需要线程池；基准只写 INFO，但日志器依赖全局 tp
+    tp = new ThreadPool(mylog::util::LogConfig::GetJsonData()->thread_count);
+
+    Json::Value root;
+    root["hardware_concurrency"] = std::thread::hardware_concurrency();
+    root["backend_threads"] =
+        static_cast<Json::Int64>(mylog::util::LogConfig::GetJsonData()->backend_threads);
+    root["messages_per_producer"] = static_cast<Json::UInt64>(opt.messages);
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    for (const auto &type : opt.types)
+        for (const auto &sink : opt.sinks)
+            for (const int size : opt.sizes)
+                for (const int producers : opt.producers)
+                    cases.append(RunCase(opt, type, sink, size, producers));
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        json += "\n";
+        for (size_t off = 0; off < json.size();) {
+            const ssize_t n = write(result_fd, json.data() + off, json.size() - off);
+            if (n <= 0)
+                break;
+            off += n;
+        }
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    delete tp;
+    return 0;
+}
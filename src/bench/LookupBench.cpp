@@ -0,0 +1,127 @@
+// 日志器查找基准测试
+//
+// 对 --threads 中的每个线程数，所有线程同时反复按名字取同一个日志器，
+// 比较每次走注册表的 GetLogger(name) 和缓存了指针的 LoggerRef 的单次耗时。
+// 结果以 JSON 输出，便于不同版本之间比较回归；线程池的诊断信息走标准错误。
+//
+// 用法(在 build 目录下运行，配置文件按 ../log_system/log_src/config.conf 查找)：
+//   ./LookupBench [--lookups N] [--threads 1,8] [--out result.json]
+#include "../../log_system/log_src/MyLog.hpp"
+#include "../../log_system/log_src/ThreadPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+ThreadPool *tp = nullptr;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+const char *const kLoggerName = "lookup_bench";
+
+struct Options {
+    int lookups = 1000000; // 每个线程的查找次数
+    std::vector<int> threads = {1, 8};
+    std::string out;
+};
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--lookups") {
+                opt->lookups = std::stoi(value);
+            } else if (key == "--threads") {
+                opt->threads.clear();
+                std::stringstream ss(value);
+                std::string item;
+                while (std::getline(ss, item, ','))
+                    opt->threads.push_back(std::stoi(item));
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// threads 个线程各调用 lookups 次 lookup，返回平均每次的纳秒数
+template <typename Lookup>
+double Measure(const int threads, const int lookups, Lookup lookup) {
+    std::atomic<size_t> sink{0};
+    const auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&]() {
+            size_t local = 0;
+            for (int i = 0; i < lookups; i++)
+                local += reinterpret_cast<uintptr_t>(lookup()) & 1;
+            sink += local;
+        });
+    for (auto &w : workers)
+        w.join();
+    const double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    return ns / (static_cast<double>(threads) * lookups);
+}
+
+Json::Value RunCase(const Options &opt, const int threads) {
+    Json::Value result;
+    result["threads"] = threads;
+    result["get_logger_ns"] = Measure(threads, opt.lookups, []() {
+        return mylog::GetLogger(kLoggerName).get();
+    });
+    result["logger_ref_ns"] = Measure(threads, opt.lookups, []() {
+        static mylog::LoggerRef logger(kLoggerName);
+        return logger.get();
+    });
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    tp = new ThreadPool(mylog::util::LogConfig::GetJsonData()->thread_count);
+    // 只查找不写日志，输出方向不会被用到
+    std::shared_ptr<mylog::LoggerBuilder> builder(new mylog::LoggerBuilder());
+    builder->BuildName(kLoggerName);
+    builder->BuildLoggerFlush<mylog::StdoutFlush>();
+    mylog::LoggerManager::GetInstance().AddLogger(builder->Build());
+
+    Json::Value root;
+    root["hardware_concurrency"] = std::thread::hardware_concurrency();
+    root["lookups_per_thread"] = opt.lookups;
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    for (const int threads : opt.threads)
+        cases.append(RunCase(opt, threads));
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    delete tp;
+    return 0;
+}
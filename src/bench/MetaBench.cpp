@@ -0,0 +1,272 @@
+// 元数据启动基准测试
+//
+// 对 --entries 中的每个记录数 N：
+//   - 生成 N 条存储信息，写成二进制快照(MetaIndex::Write)
+//   - 构造 DataManager，测量启动加载时间和常驻内存增量，再测量按 URL、
+//     按存储路径随机查询和按修改时间区间查询的延迟
+//   - mmap 打开快照，在映射上随机按 URL 二分查找，测量单次查询延迟
+//   - N 不超过 --json-max 时，同样的记录写成旧的 JSON 快照，测量导入时间
+//     (jsoncpp 每条记录约占 1KB，千万条装不进小内存的机器)
+// 结果以 JSON 输出，便于不同版本之间比较回归。
+//
+// 用法(在 build 目录下运行，日志配置按 ../log_system/log_src/config.conf 查找；
+// 会在 --dir 下生成 Storage.conf 和快照文件)：
+//   ./MetaBench [--entries 1000000,10000000] [--json-max 1000000]
+//               [--lookups 1000000] [--dir ./metabench] [--out result.json]
+#include "../server/DataManager.hpp"
+#include <malloc.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+ThreadPool *tp = nullptr;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<uint64_t> entries = {1000000, 10000000};
+    uint64_t json_max = 1000000;
+    uint64_t lookups = 1000000;
+    std::string dir = "./metabench";
+    std::string out;
+};
+
+std::vector<uint64_t> ParseList(const std::string &value) {
+    std::vector<uint64_t> list;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        list.push_back(std::stoull(item));
+    return list;
+}
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--entries") {
+                opt->entries = ParseList(value);
+            } else if (key == "--json-max") {
+                opt->json_max = std::stoull(value);
+            } else if (key == "--lookups") {
+                opt->lookups = std::stoull(value);
+            } else if (key == "--dir") {
+                opt->dir = value;
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+double Seconds(const Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 当前常驻内存(MB)，先把空闲内存还给系统，减少上一轮留下的干扰
+double RssMb() {
+    malloc_trim(0);
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line))
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return std::stod(line.substr(6)) / 1024;
+    return 0;
+}
+
+// 和服务端生成的记录长度相近：/download/ 前缀加文件名
+std::string Url(const uint64_t i) {
+    return "/download/dir_" + std::to_string(i % 1000) + "/file_" +
+           std::to_string(i) + ".bin";
+}
+
+storage::StorageInfo MakeInfo(const uint64_t i) {
+    storage::StorageInfo info;
+    info.mtime_ = 1700000000 + i;
+    info.atime_ = info.mtime_;
+    info.fsize_ = 4096 + i % 65536;
+    info.url_ = Url(i);
+    info.storage_path_ = "./low_storage/file_" + std::to_string(i) + ".bin";
+    return info;
+}
+
+// 逐条写出旧的 JSON 快照，不在内存中构造整个 Json::Value
+bool WriteJson(const std::string &path, const uint64_t n) {
+    std::ofstream ofs(path);
+    ofs << "[\n";
+    for (uint64_t i = 0; i < n; ++i) {
+        const storage::StorageInfo info = MakeInfo(i);
+        ofs << "{\"atime_\":" << info.atime_ << ",\"fsize_\":" << info.fsize_
+            << ",\"mtime_\":" << info.mtime_ << ",\"storage_path_\":\""
+            << info.storage_path_ << "\",\"url_\":\"" << info.url_ << "\"}"
+            << (i + 1 < n ? ",\n" : "\n");
+    }
+    ofs << "]\n";
+    return static_cast<bool>(ofs);
+}
+
+Json::Value RunCase(const Options &opt, const uint64_t n) {
+    Json::Value result;
+    result["entries"] = static_cast<Json::UInt64>(n);
+    const std::string snapshot = "./storage.data";
+    remove((snapshot + ".journal").c_str());
+    remove((snapshot + ".journal.old").c_str());
+
+    // 写二进制快照
+    {
+        std::vector<storage::StorageInfo> arr;
+        arr.reserve(n);
+        for (uint64_t i = 0; i < n; ++i)
+            arr.push_back(MakeInfo(i));
+        const auto start = Clock::now();
+        if (!storage::MetaIndex::Write(snapshot, &arr)) {
+            result["error"] = "write snapshot failed";
+            return result;
+        }
+        result["write_s"] = Seconds(start);
+        result["snapshot_bytes"] = static_cast<Json::UInt64>(
+            storage::FileUtil(snapshot).FileSize());
+    }
+
+    // 服务端启动：构造 DataManager 把快照装进哈希表
+    {
+        const double rss = RssMb();
+        const auto start = Clock::now();
+        auto *dm = new storage::DataManager();
+        result["load_s"] = Seconds(start);
+        result["load_rss_mb"] = RssMb() - rss;
+
+        std::mt19937_64 rng(n);
+        std::vector<storage::StorageInfo> keys;
+        for (uint64_t i = 0; i < std::min<uint64_t>(opt.lookups, 100000); ++i)
+            keys.push_back(MakeInfo(rng() % n));
+        uint64_t found = 0;
+        storage::StorageInfoPtr info;
+        auto lookup_start = Clock::now();
+        for (uint64_t i = 0; i < opt.lookups; ++i)
+            found += dm->GetOneByURL(keys[i % keys.size()].url_, &info);
+        result["url_lookup_ns"] =
+            Seconds(lookup_start) * 1e9 / std::max<uint64_t>(opt.lookups, 1);
+        lookup_start = Clock::now();
+        for (uint64_t i = 0; i < opt.lookups; ++i)
+            found += dm->GetOneByStoragePath(keys[i % keys.size()].storage_path_,
+                                             &info);
+        result["path_lookup_ns"] =
+            Seconds(lookup_start) * 1e9 / std::max<uint64_t>(opt.lookups, 1);
+        // 修改时间连续分布，取 1000 条记录宽的区间
+        std::vector<storage::StorageInfoPtr> range;
+        lookup_start = Clock::now();
+        const uint64_t ranges = std::max<uint64_t>(opt.lookups / 10000, 1);
+        for (uint64_t i = 0; i < ranges; ++i) {
+            range.clear();
+            const time_t from = keys[i % keys.size()].mtime_;
+            dm->GetByMtime(from, from + 999, &range);
+        }
+        result["mtime_range_us"] = Seconds(lookup_start) * 1e6 / ranges;
+        if (found != 2 * opt.lookups)
+            result["error"] = "loaded table misses a record";
+        delete dm;
+    }
+
+    // 不装进内存，直接在映射上查询
+    {
+        const auto start = Clock::now();
+        storage::MetaIndex index;
+        if (!index.Open(snapshot)) {
+            result["error"] = "open snapshot failed";
+            return result;
+        }
+        result["mmap_open_s"] = Seconds(start);
+        std::mt19937_64 rng(n);
+        std::vector<std::string> urls;
+        for (uint64_t i = 0; i < std::min<uint64_t>(opt.lookups, 100000); ++i)
+            urls.push_back(Url(rng() % n));
+        uint64_t found = 0;
+        storage::MetaIndex::Entry entry;
+        const auto lookup_start = Clock::now();
+        for (uint64_t i = 0; i < opt.lookups; ++i)
+            found += index.Find(urls[i % urls.size()], &entry);
+        result["mmap_lookup_ns"] =
+            Seconds(lookup_start) * 1e9 / std::max<uint64_t>(opt.lookups, 1);
+        if (found != opt.lookups)
+            result["error"] = "mmap lookup misses a record";
+    }
+
+    // 旧的 JSON 快照导入
+    if (n <= opt.json_max) {
+        const std::string json = "./storage.json";
+        WriteJson(json, n);
+        result["json_bytes"] =
+            static_cast<Json::UInt64>(storage::FileUtil(json).FileSize());
+        remove(snapshot.c_str());
+        remove((snapshot + ".journal").c_str());
+        storage::DataManager dm;
+        const auto start = Clock::now();
+        if (!dm.ImportJson(json))
+            result["error"] = "import json failed";
+        result["json_load_s"] = Seconds(start);
+        remove(json.c_str());
+    }
+    remove(snapshot.c_str());
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt) || opt.entries.empty())
+        return 1;
+    // 日志配置按当前目录查找，先建好 logger 再进入工作目录
+    std::shared_ptr<mylog::LoggerBuilder> builder(new mylog::LoggerBuilder());
+    builder->BuildName("cloud_storage");
+    builder->BuildLoggerFlush<mylog::FileFlush>("./MetaBench.log");
+    mylog::LoggerManager::GetInstance().AddLogger(builder->Build());
+    storage::FileUtil(opt.dir).CreateDirectory();
+    if (chdir(opt.dir.c_str()) != 0) {
+        std::cerr << "chdir " << opt.dir << " failed" << std::endl;
+        return 1;
+    }
+    // DataManager 从当前目录的 Storage.conf 读取快照路径
+    const std::string conf =
+        "{\"storage_info\" : \"./storage.data\", \"metadata_fsync\" : 0}\n";
+    storage::FileUtil("Storage.conf").SetContent(conf.data(), conf.size());
+
+    Json::Value root;
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    for (const uint64_t n : opt.entries) {
+        Json::Value result = RunCase(opt, n);
+        std::cerr << n << " entries: load " << result["load_s"].asDouble()
+                  << " s, " << result["load_rss_mb"].asDouble() << " MB"
+                  << std::endl;
+        cases.append(result);
+    }
+
+    std::string json;
+    storage::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    return 0;
+}
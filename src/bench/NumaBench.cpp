@@ -0,0 +1,126 @@
+// NUMA 放置基准测试
+//
+// 生产者线程和日志器的独立后台线程绑在同一个 NUMA 节点 / 不同节点的
+// CPU 上，分别测量 --messages 条日志的提交吞吐量和端到端排空时间
+// (AsyncLogger::Flush 屏障)。只有一个节点时只测同节点。
+// 结果以 JSON 输出，便于不同版本之间比较回归；线程池的诊断信息走标准错误。
+//
+// 用法(在 build 目录下运行，配置文件按 ../log_system/log_src/config.conf 查找)：
+//   ./NumaBench [--messages N] [--out result.json]
+#include "../../log_system/log_src/MyLog.hpp"
+#include "../../log_system/log_src/ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+ThreadPool *tp = nullptr;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using mylog::util::Affinity;
+
+struct Options {
+    int messages = 200000;
+    std::string out;
+};
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--messages") {
+                opt->messages = std::stoi(value);
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+Json::Value RunCase(const Options &opt, const std::string &name,
+                    const int producer_cpu, const int worker_cpu) {
+    std::shared_ptr<mylog::LoggerBuilder> builder(new mylog::LoggerBuilder());
+    builder->BuildName(name);
+    builder->BuildSharedBackend(false);
+    builder->BuildWorkerCpus(std::to_string(worker_cpu));
+    builder->BuildLoggerFlush<mylog::FileFlush>("./bench_logs/" + name + ".log");
+    auto logger = builder->Build();
+
+    Json::Value result;
+    result["case"] = name;
+    result["producer_cpu"] = producer_cpu;
+    result["worker_cpu"] = worker_cpu;
+    std::thread producer([&]() {
+        Affinity::PinCurrent({producer_cpu});
+        const auto start = Clock::now();
+        for (int i = 0; i < opt.messages; i++)
+            logger->Info("numa placement test message %d", i);
+        const auto submitted = Clock::now();
+        result["drained"] = logger->Flush(std::chrono::seconds(120));
+        const auto end = Clock::now();
+        result["submit_msgs_per_s"] =
+            opt.messages /
+            std::chrono::duration<double>(submitted - start).count();
+        result["drain_s"] = std::chrono::duration<double>(end - start).count();
+    });
+    producer.join();
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    tp = new ThreadPool(mylog::util::LogConfig::GetJsonData()->thread_count);
+
+    // 按节点分组 CPU，查不到拓扑的 CPU 算作节点 0
+    const int cpu_count = static_cast<int>(std::thread::hardware_concurrency());
+    std::vector<std::vector<int>> node_cpus(std::max(Affinity::NodeCount(), 1));
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+        const int node = std::max(Affinity::NodeOfCpu(cpu), 0);
+        if (node < static_cast<int>(node_cpus.size()))
+            node_cpus[node].push_back(cpu);
+    }
+
+    Json::Value root;
+    root["hardware_concurrency"] = cpu_count;
+    root["numa_nodes"] = static_cast<Json::UInt64>(node_cpus.size());
+    root["messages"] = opt.messages;
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    const auto &local = node_cpus[0];
+    if (!local.empty()) {
+        cases.append(RunCase(opt, "numa_same_node", local.front(), local.back()));
+        if (node_cpus.size() > 1 && !node_cpus[1].empty())
+            cases.append(RunCase(opt, "numa_cross_node", local.front(),
+                                 node_cpus[1].front()));
+    }
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    delete tp;
+    return 0;
+}
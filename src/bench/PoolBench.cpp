@@ -0,0 +1,288 @@
+// 线程池基准测试
+//
+// --cases 中的每一项单独测量：
+//   - steal：细粒度任务吞吐量。外部线程逐个提交(走全局注入队列)，以及每个
+//     根任务再提交 100 个子任务(走工作线程本地队列和窃取)
+//   - timers：--timers 个 1 ~ 1000 ms 的定时任务的插入、取消一半的单次开销，
+//     以及其余定时任务的触发延迟 p50/p99/max
+//   - classes：低优先级类里压入 --bulk 个 200 us 的任务形成洪峰，期间每
+//     500 us 向高优先级类提交一个 20 us 的任务，共 --urgent 个，输出两个类
+//     排队等待和执行耗时的 p50/p99
+// 结果以 JSON 输出，便于不同版本之间比较回归；线程池的诊断信息走标准错误。
+//
+// 用法(在 build 目录下运行，配置文件按 ../log_system/log_src/config.conf 查找)：
+//   ./PoolBench [--tasks N] [--timers N] [--bulk N] [--urgent N] [--threads N]
+//               [--cases steal,timers,classes] [--out result.json]
+#include "../../log_system/log_src/MyLog.hpp"
+#include "../../log_system/log_src/ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+ThreadPool *tp = nullptr;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int tasks = 1000000;
+    int timers = 50000;
+    int bulk = 2000;
+    int urgent = 200;
+    int threads = 0; // 0 表示用配置文件中的 thread_count
+    std::vector<std::string> cases = {"steal", "timers", "classes"};
+    std::string out;
+};
+
+std::vector<std::string> SplitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--tasks") {
+                opt->tasks = std::stoi(value);
+            } else if (key == "--timers") {
+                opt->timers = std::stoi(value);
+            } else if (key == "--bulk") {
+                opt->bulk = std::stoi(value);
+            } else if (key == "--urgent") {
+                opt->urgent = std::stoi(value);
+            } else if (key == "--threads") {
+                opt->threads = std::stoi(value);
+            } else if (key == "--cases") {
+                opt->cases = SplitList(value);
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+double Seconds(const Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 约 100 次加法的小任务
+void Work() {
+    volatile unsigned x = 0;
+    for (int i = 0; i < 100; i++)
+        x = x + i;
+}
+
+void WaitDone(const std::atomic<int> &done, const int target) {
+    while (done.load() < target)
+        std::this_thread::yield();
+}
+
+Json::Value RunSteal(const Options &opt) {
+    Json::Value result;
+    result["case"] = "steal";
+    result["tasks"] = opt.tasks;
+
+    // 外部线程逐个提交
+    std::atomic<int> done{0};
+    auto start = Clock::now();
+    for (int i = 0; i < opt.tasks; i++)
+        tp->post([&]() {
+            Work();
+            done++;
+        });
+    WaitDone(done, opt.tasks);
+    result["external_tasks_per_s"] = opt.tasks / Seconds(start);
+
+    // 每个根任务再提交 fanout 个子任务
+    const int fanout = 100;
+    const int total = opt.tasks / fanout * fanout;
+    done = 0;
+    start = Clock::now();
+    for (int i = 0; i < opt.tasks / fanout; i++)
+        tp->post([&]() {
+            for (int j = 0; j < fanout; j++)
+                tp->post([&]() {
+                    Work();
+                    done++;
+                });
+        });
+    WaitDone(done, total);
+    result["nested_tasks_per_s"] = total / Seconds(start);
+    return result;
+}
+
+double Percentile(const std::vector<int64_t> &sorted, const double p) {
+    if (sorted.empty())
+        return 0;
+    const size_t idx = std::min(sorted.size() - 1,
+                                static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+
+Json::Value RunTimers(const Options &opt) {
+    Json::Value result;
+    result["case"] = "timers";
+    result["timers"] = opt.timers;
+
+    const int n = opt.timers;
+    std::vector<Clock::time_point> due(n);
+    std::vector<std::atomic<int64_t>> late_us(n);
+    std::vector<ThreadPool::TimerId> ids(n);
+    std::atomic<int> fired{0};
+    const auto base = Clock::now();
+    for (int i = 0; i < n; i++) {
+        const auto delay = std::chrono::milliseconds(1 + (i * 7919) % 1000);
+        due[i] = Clock::now() + delay;
+        late_us[i] = INT64_MIN;
+        ids[i] = tp->scheduleAfter(delay, [&, i]() {
+            late_us[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+                             Clock::now() - due[i])
+                             .count();
+            fired++;
+        });
+    }
+    result["insert_ns"] = Seconds(base) * 1e9 / std::max(n, 1);
+
+    // 取消一半，已经触发的取消会失败
+    int cancelled = 0;
+    const auto start = Clock::now();
+    for (int i = 1; i < n; i += 2)
+        cancelled += tp->cancelTimer(ids[i]) ? 1 : 0;
+    result["cancel_ns"] = Seconds(start) * 1e9 / std::max(n / 2, 1);
+    result["cancelled"] = cancelled;
+
+    while (fired.load() < n - cancelled &&
+           Clock::now() - base < std::chrono::seconds(5))
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // 超时没触发的也取消，回调引用的是本函数的局部变量
+    for (const auto id : ids)
+        tp->cancelTimer(id);
+    std::vector<int64_t> lates;
+    for (auto &late : late_us)
+        if (late.load() != INT64_MIN)
+            lates.push_back(late.load());
+    std::sort(lates.begin(), lates.end());
+    result["fired"] = static_cast<Json::UInt64>(lates.size());
+    Json::Value latency;
+    latency["p50"] = Percentile(lates, 0.5);
+    latency["p99"] = Percentile(lates, 0.99);
+    latency["max"] = lates.empty() ? 0.0 : static_cast<double>(lates.back());
+    result["late_us"] = latency;
+    return result;
+}
+
+// 忙等 us 微秒，模拟占用工作线程的任务
+void Spin(const int us) {
+    const auto end = Clock::now() + std::chrono::microseconds(us);
+    while (Clock::now() < end) {
+    }
+}
+
+Json::Value RunClasses(const Options &opt) {
+    Json::Value result;
+    result["case"] = "classes";
+    const auto bulk = tp->addClass("bench_bulk", -10, 2);
+    const auto urgent = tp->addClass("bench_urgent", 10, 2, 4096);
+    std::atomic<int> done{0};
+    for (int i = 0; i < opt.bulk; i++)
+        tp->postTo(bulk, [&]() {
+            Spin(200);
+            done++;
+        });
+    for (int i = 0; i < opt.urgent; i++) {
+        // 队列满被拒绝的不会执行，直接计为完成
+        if (!tp->postTo(urgent, [&]() {
+                Spin(20);
+                done++;
+            }))
+            done++;
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    while (done.load() < opt.bulk + opt.urgent)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    Json::Value &classes = result["classes"];
+    classes = Json::Value(Json::arrayValue);
+    for (const auto cls : {bulk, urgent}) {
+        const auto stats = tp->classStats(cls);
+        Json::Value item;
+        item["name"] = stats.name;
+        item["priority"] = stats.priority;
+        item["completed"] = static_cast<Json::UInt64>(stats.completed);
+        item["wait_p50_us"] = static_cast<Json::UInt64>(
+            LatencyHistogram::percentile(stats.waitHist, 0.5));
+        item["wait_p99_us"] = static_cast<Json::UInt64>(
+            LatencyHistogram::percentile(stats.waitHist, 0.99));
+        item["run_p50_us"] = static_cast<Json::UInt64>(
+            LatencyHistogram::percentile(stats.runHist, 0.5));
+        item["run_p99_us"] = static_cast<Json::UInt64>(
+            LatencyHistogram::percentile(stats.runHist, 0.99));
+        classes.append(item);
+    }
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    const int threads = opt.threads > 0
+                            ? opt.threads
+                            : mylog::util::LogConfig::GetJsonData()->thread_count;
+    tp = new ThreadPool(threads, threads);
+
+    Json::Value root;
+    root["hardware_concurrency"] = std::thread::hardware_concurrency();
+    root["threads"] = threads;
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    for (const auto &name : opt.cases) {
+        if (name == "steal") {
+            cases.append(RunSteal(opt));
+        } else if (name == "timers") {
+            cases.append(RunTimers(opt));
+        } else if (name == "classes") {
+            cases.append(RunClasses(opt));
+        } else {
+            std::cerr << "unknown case " << name << std::endl;
+            return 1;
+        }
+    }
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    delete tp;
+    return 0;
+}
@@ -0,0 +1,233 @@
+// 断点续传基准测试
+//
+// 模拟客户端在文件的不同位置中断后用 "Range: bytes=<offset>-" 续传：
+//   - 先 HEAD 取得文件总长
+//   - 对每个续传位置各请求 --repeat 次，统计响应码、实际收到的正文字节、
+//     其中多传的字节(正文长度 - (总长 - offset))以及耗时
+// 服务端若忽略 Range 从头重发，多传字节就等于 offset，便于前后版本对比。
+// 结果以 JSON 输出。
+//
+// 用法(先启动服务端并上传好测试文件)：
+//   ./ResumeBench --url /download/big.bin [--host 127.0.0.1] [--port 8081]
+//                 [--offsets 0,0.25,0.5,0.75,0.99] [--repeat 5]
+//                 [--out result.json]
+#include "../../log_system/log_src/Util.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    std::string url;
+    std::vector<double> offsets = {0, 0.25, 0.5, 0.75, 0.99}; // 占总长的比例
+    int repeat = 5;
+    std::string out;
+};
+
+struct Response {
+    int status = 0;
+    uint64_t header_bytes = 0;
+    uint64_t body_bytes = 0;
+    uint64_t content_length = 0;
+};
+
+bool ParseOptions(int argc, char *argv[], Options *opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << key << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (key == "--host") {
+                opt->host = value;
+            } else if (key == "--port") {
+                opt->port = std::stoi(value);
+            } else if (key == "--url") {
+                opt->url = value;
+            } else if (key == "--offsets") {
+                opt->offsets.clear();
+                std::stringstream ss(value);
+                std::string item;
+                while (std::getline(ss, item, ','))
+                    if (!item.empty())
+                        opt->offsets.push_back(std::stod(item));
+            } else if (key == "--repeat") {
+                opt->repeat = std::stoi(value);
+            } else if (key == "--out") {
+                opt->out = value;
+            } else {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "bad value for " << key << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (opt->url.empty()) {
+        std::cerr << "--url is required" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 发一个 Connection: close 的请求并读到对端关闭，正文只计数不保存
+bool Request(const Options &opt, const std::string &method,
+             const std::string &range, Response *resp) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return false;
+    }
+    std::string req = method + " " + opt.url + " HTTP/1.1\r\nHost: " +
+                      opt.host + "\r\nConnection: close\r\n";
+    if (!range.empty())
+        req += "Range: " + range + "\r\n";
+    req += "\r\n";
+    if (send(fd, req.data(), req.size(), 0) != (ssize_t)req.size()) {
+        close(fd);
+        return false;
+    }
+
+    std::string head;
+    bool in_body = false;
+    std::vector<char> buf(256 * 1024);
+    ssize_t n;
+    while ((n = recv(fd, buf.data(), buf.size(), 0)) > 0) {
+        if (in_body) {
+            resp->body_bytes += n;
+            continue;
+        }
+        head.append(buf.data(), n);
+        auto pos = head.find("\r\n\r\n");
+        if (pos == std::string::npos)
+            continue;
+        in_body = true;
+        resp->header_bytes = pos + 4;
+        resp->body_bytes = head.size() - resp->header_bytes;
+        head.resize(pos);
+    }
+    close(fd);
+    if (n < 0 || !in_body)
+        return false;
+
+    // 状态行 "HTTP/1.1 206 Partial Content"
+    std::istringstream lines(head);
+    std::string line, version;
+    std::getline(lines, line);
+    std::istringstream(line) >> version >> resp->status;
+    while (std::getline(lines, line)) {
+        if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+            resp->content_length = std::stoull(line.substr(15));
+    }
+    return resp->status != 0;
+}
+
+Json::Value RunOffset(const Options &opt, const uint64_t size,
+                      const double ratio) {
+    const uint64_t offset =
+        std::min<uint64_t>(static_cast<uint64_t>(size * ratio),
+                           size > 0 ? size - 1 : 0);
+    const uint64_t wanted = size - offset;
+    const std::string range = "bytes=" + std::to_string(offset) + "-";
+
+    Json::Value result;
+    result["offset"] = static_cast<Json::UInt64>(offset);
+    result["wanted_bytes"] = static_cast<Json::UInt64>(wanted);
+    uint64_t wire = 0, body = 0;
+    double total_s = 0;
+    int status = 0;
+    for (int i = 0; i < opt.repeat; ++i) {
+        Response resp;
+        const auto begin = Clock::now();
+        if (!Request(opt, "GET", range, &resp)) {
+            std::cerr << "request failed at offset " << offset << std::endl;
+            result["error"] = true;
+            return result;
+        }
+        total_s += std::chrono::duration<double>(Clock::now() - begin).count();
+        wire += resp.header_bytes + resp.body_bytes;
+        body += resp.body_bytes;
+        status = resp.status;
+    }
+    const double avg_s = total_s / opt.repeat;
+    const uint64_t avg_body = body / opt.repeat;
+    result["status"] = status;
+    result["body_bytes"] = static_cast<Json::UInt64>(avg_body);
+    result["wire_bytes"] = static_cast<Json::UInt64>(wire / opt.repeat);
+    result["wasted_bytes"] =
+        static_cast<Json::UInt64>(avg_body > wanted ? avg_body - wanted : 0);
+    result["ms"] = avg_s * 1000;
+    result["mb_per_sec"] = avg_body / avg_s / (1024 * 1024);
+    std::cerr << "offset " << offset << ": " << status << ", " << avg_body
+              << " bytes, " << avg_s * 1000 << " ms" << std::endl;
+    return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!ParseOptions(argc, argv, &opt))
+        return 1;
+    Response head;
+    if (!Request(opt, "HEAD", "", &head) || head.status != 200) {
+        std::cerr << "HEAD " << opt.url << " failed, status " << head.status
+                  << std::endl;
+        return 1;
+    }
+    // 旧版本 HEAD 回复不带 Content-Length，退回完整 GET 一次取总长
+    if (head.content_length == 0) {
+        Response full;
+        if (!Request(opt, "GET", "", &full))
+            return 1;
+        head.content_length = full.body_bytes;
+    }
+
+    Json::Value root;
+    root["url"] = opt.url;
+    root["file_bytes"] = static_cast<Json::UInt64>(head.content_length);
+    root["repeat"] = opt.repeat;
+    Json::Value &cases = root["cases"];
+    cases = Json::Value(Json::arrayValue);
+    uint64_t wanted = 0, received = 0;
+    for (const double ratio : opt.offsets) {
+        Json::Value one = RunOffset(opt, head.content_length, ratio);
+        wanted += one["wanted_bytes"].asUInt64();
+        received += one["body_bytes"].asUInt64();
+        cases.append(one);
+    }
+    root["total_wanted_bytes"] = static_cast<Json::UInt64>(wanted);
+    root["total_body_bytes"] = static_cast<Json::UInt64>(received);
+
+    std::string json;
+    mylog::util::JsonUtil::Serialize(root, &json);
+    if (opt.out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(opt.out);
+        ofs << json << std::endl;
+    }
+    return 0;
+}
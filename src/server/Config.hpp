@@ -16,22 +16,31 @@ namespace storage
         std::string deep_storage_dir_;     // 深度存储文件的存储路径
         std::string low_storage_dir_;     // 浅度存储文件的存储路径
         std::string storage_info_;     // 已存储文件的信息
+        std::string event_loop_cpus_;  // 事件循环线程绑定的 CPU 列表，空表示不绑定
+        int event_loop_threads_;       // 事件循环线程数，0 表示与 CPU 核数相同
+        uint64_t max_upload_bytes_;    // 单个上传请求体的上限，0 表示不限
+        int zstd_level_;               // 深度存储的压缩级别
+        int zstd_workers_;             // 深度存储的压缩线程数，0 表示在调用线程中压缩
+        size_t zstd_frame_size_;       // 深度存储每帧的原始大小，0 表示整个文件一帧
+        bool metadata_fsync_;          // 元数据日志每批记录写完后是否 fdatasync
+        uint64_t metadata_compact_bytes_; // 元数据日志超过该字节数(且超过上一份快照)时写快照
+        uint64_t metadata_compact_check_ms_; // 多久检查一次元数据日志长度，0 表示每次插入后检查
     private:
         Config()
         {
             if (ReadConfig() == false)
             {
-                mylog::GetLogger("cloud_storage")->Fatal("ReadConfig failed");
+                Logger()->Fatal("ReadConfig failed");
                 return;
             }
-            mylog::GetLogger("cloud_storage")->Info("ReadConfig complicate");
+            Logger()->Info("ReadConfig complicate");
         }
 
     public:
         // 读取配置文件信息
         bool ReadConfig()
         {
-            mylog::GetLogger("cloud_storage")->Info("ReadConfig start");
+            Logger()->Info("ReadConfig start");
 
             storage::FileUtil fu(Config_File);
             std::string content;
@@ -50,6 +59,19 @@ namespace storage
             storage_info_ = root["storage_info"].asString();
             deep_storage_dir_ = root["deep_storage_dir"].asString();
             low_storage_dir_ = root["low_storage_dir"].asString();
+            event_loop_cpus_ = root.get("event_loop_cpus", "").asString();
+            event_loop_threads_ = root.get("event_loop_threads", 1).asInt();
+            max_upload_bytes_ = root.get("max_upload_bytes", 0).asUInt64();
+            zstd_level_ = root.get("zstd_level", 3).asInt();
+            zstd_workers_ = root.get("zstd_workers", 0).asInt();
+            // 跳转表里的大小是 u32，帧不能超过 4GB，这里限制在 1GB 以内
+            zstd_frame_size_ = std::min<uint64_t>(
+                root.get("zstd_frame_size", 1048576).asUInt64(), 1ull << 30);
+            metadata_fsync_ = root.get("metadata_fsync", 1).asInt() != 0;
+            metadata_compact_bytes_ =
+                root.get("metadata_compact_bytes", 64 << 20).asUInt64();
+            metadata_compact_check_ms_ =
+                root.get("metadata_compact_check_ms", 1000).asUInt64();
             
             return true;
         }
@@ -77,6 +99,42 @@ namespace storage
         {
             return storage_info_;
         }
+        std::string GetEventLoopCpus()
+        {
+            return event_loop_cpus_;
+        }
+        int GetEventLoopThreads()
+        {
+            return event_loop_threads_;
+        }
+        uint64_t GetMaxUploadBytes()
+        {
+            return max_upload_bytes_;
+        }
+        int GetZstdLevel()
+        {
+            return zstd_level_;
+        }
+        int GetZstdWorkers()
+        {
+            return zstd_workers_;
+        }
+        size_t GetZstdFrameSize()
+        {
+            return zstd_frame_size_;
+        }
+        bool GetMetadataFsync()
+        {
+            return metadata_fsync_;
+        }
+        uint64_t GetMetadataCompactBytes()
+        {
+            return metadata_compact_bytes_;
+        }
+        uint64_t GetMetadataCompactCheckMs()
+        {
+            return metadata_compact_check_ms_;
+        }
 
     public:
         // 获取单例类对象 - 使用现代C++的线程安全局部静态变量方式
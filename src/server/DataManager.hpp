@@ -1,7 +1,13 @@
 #pragma once
 #include "Config.hpp"
-#include <unordered_map>
-#include <pthread.h>
+#include "MetaIndex.hpp"
+#include "MetaJournal.hpp"
+#include "MetaTable.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 namespace storage
 {
     // 用作初始化存储文件的属性信息
@@ -15,11 +21,11 @@ namespace storage
         bool NewStorageInfo(const std::string &storage_path)
         {
             // 初始化备份文件的信息
-            mylog::GetLogger("cloud_storage")->Info("NewStorageInfo start");
+            Logger()->Info("NewStorageInfo start");
             FileUtil f(storage_path);
             if (!f.Exists())
             {
-                mylog::GetLogger("cloud_storage")->Info("file not exists");
+                Logger()->Info("file not exists");
                 return false;
             }
             mtime_ = f.LastAccessTime();
@@ -30,28 +36,60 @@ namespace storage
             // 下载路径前缀+文件名
             storage::Config *config = storage::Config::GetInstance();
             url_ = config->GetDownloadPrefix() + f.FileName();
-            mylog::GetLogger("cloud_storage")->Info("download_url:%s,mtime_:%s,atime_:%s,fsize_:%d", url_.c_str(),ctime(&mtime_),ctime(&atime_),fsize_);
-            mylog::GetLogger("cloud_storage")->Info("NewStorageInfo end");
+            // ctime 返回共享的静态缓冲区，多个事件循环线程同时上传时会互相覆盖
+            char mtime_buf[32], atime_buf[32];
+            Logger()->Info("download_url:%s,mtime_:%s,atime_:%s,fsize_:%d", url_.c_str(),ctime_r(&mtime_, mtime_buf),ctime_r(&atime_, atime_buf),fsize_);
+            Logger()->Info("NewStorageInfo end");
             return true;
         }
     } StorageInfo; // namespace StorageInfo
 
+    // 查询返回的记录快照，放进内存表后不再修改，只增加引用计数不复制字符串
+    using StorageInfoPtr = std::shared_ptr<const StorageInfo>;
+
     /**
      * 存储信息管理器 - 负责管理文件存储元数据
      * 
      * 功能特点：
      * 1. 内存缓存 + 文件持久化的双层存储架构
-     * 2. 读写锁保证线程安全的并发访问
-     * 3. JSON序列化实现数据持久化
-     * 4. 支持按URL和存储路径查询文件信息
+     * 2. 内存表按 URL 分片加读写锁(MetaTable)，查询返回共享的只读记录
+     * 3. 快照 + 只追加日志实现数据持久化：每次插入只向日志追加一条记录
+     *    (MetaJournal，组提交 fsync)，代价与已有文件数无关；日志超过阈值时
+     *    在线程池中写一份完整的二进制快照(MetaIndex)并丢弃旧日志。JSON 只
+     *    用于导入导出，旧版本留下的 JSON 快照在启动时导入
+     * 4. 支持按URL和存储路径查询文件信息，按修改时间和大小做区间查询，
+     *    都走内存表维护的索引，不扫描全表
+     *
+     * 快照流程：日志改名为 <storage_info>.journal.old，之后的记录写进新日志；
+     * 再复制内存表写快照(先写临时文件、fsync 后 rename)，成功后删除旧日志。
+     * 插入先改内存表再写日志，所以改名前写进旧日志的记录一定在复制的表里。
+     * 恢复时依次加载快照、旧日志(快照中途失败时才存在)和当前日志。
      */
     class DataManager
     {
     private:
-        std::string storage_file_;                                    // 存储信息持久化文件路径
-        pthread_rwlock_t rwlock_;                                    // 读写锁，支持多读单写的并发控制
-        std::unordered_map<std::string, StorageInfo> table_;         // 内存哈希表，以URL为key存储文件信息
-        bool need_persist_;                                          // 持久化标志，控制是否需要写入磁盘
+        std::string storage_file_;                                    // 存储信息持久化文件路径(快照)
+        std::string journal_file_;                                    // 快照之后的变更日志
+        std::string journal_old_file_;                                // 正在写快照时切换下来的日志
+        std::mutex persist_mutex_;                                   // 串行化快照，避免并发写同一个文件
+        MetaTable<StorageInfo> table_;                               // 内存表，以URL为key存储文件信息
+        MetaJournal journal_;                                        // 只追加的变更日志
+        uint64_t compact_bytes_;                                     // 日志超过该字节数时写快照
+        std::atomic<uint64_t> snapshot_bytes_{0};                    // 上一份快照的大小
+        std::atomic<bool> compacting_{false};                        // 已经提交了快照任务
+        bool compact_on_put_ = true;                                 // 没有定时检查时每次插入后检查日志长度
+
+        // 定时检查日志长度的任务通过它找到本对象，析构时置空
+        struct CompactTimer
+        {
+            std::mutex mutex;
+            DataManager *owner;
+            std::atomic<ThreadPool::TimerId> id{0};
+        };
+        std::shared_ptr<CompactTimer> compact_timer_;
+
+        // 日志记录类型，记录内容见 EncodePut
+        static constexpr uint8_t kRecordPut = 1;
 
     public:
         /**
@@ -59,119 +97,118 @@ namespace storage
          * 
          * 初始化流程：
          * 1. 获取持久化文件路径
-         * 2. 初始化读写锁
-         * 3. 从文件加载历史数据到内存
-         * 4. 启用持久化机制
+         * 2. 从快照和日志加载历史数据到内存
+         * 3. 打开日志准备追加
          */
         DataManager()
         {
-            mylog::GetLogger("cloud_storage")->Info("DataManager construct start");
-            storage_file_ = storage::Config::GetInstance()->GetStorageInfoFile();  // 从配置获取存储文件路径
-            pthread_rwlock_init(&rwlock_, NULL);                      // 初始化读写锁
-            need_persist_ = false;                                                 // 初始化期间禁用将文件信息持久化到JSON文件中，避免重复IO
+            Logger()->Info("DataManager construct start");
+            storage::Config *config = storage::Config::GetInstance();
+            storage_file_ = config->GetStorageInfoFile();  // 从配置获取存储文件路径
+            journal_file_ = storage_file_ + ".journal";
+            journal_old_file_ = journal_file_ + ".old";
+            compact_bytes_ = config->GetMetadataCompactBytes();
             InitLoad();                                                            // 从文件加载已有数据到内存
-            need_persist_ = true;                                                  // 初始化完成后启用持久化
-            mylog::GetLogger("cloud_storage")->Info("DataManager construct end");
+            ScheduleCompactCheck(config->GetMetadataCompactCheckMs());
+            Logger()->Info("DataManager construct end");
         }
-        /**
-         * 析构函数 - 清理资源
-         * 销毁读写锁，释放系统资源
-         */
         ~DataManager()
         {
-            pthread_rwlock_destroy(&rwlock_);  // 销毁读写锁
+            if (compact_timer_)
+            {
+                std::lock_guard<std::mutex> lock(compact_timer_->mutex);
+                compact_timer_->owner = nullptr;
+            }
+            // 已经提交的快照任务引用本对象，等它结束
+            while (compacting_)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-
         /**
          * 初始化加载 - 从持久化文件恢复数据到内存
          * 
          * 数据恢复流程：
-         * 1. 检查持久化文件是否存在
-         * 2. 读取文件内容并JSON反序列化
-         * 3. 将数据逐条插入内存哈希表
+         * 1. mmap 二进制快照，一次扫描装进内存哈希表(旧的 JSON 快照按导入处理)
+         * 2. 依次回放旧日志和当前日志，丢弃写到一半的尾部
+         * 3. 打开当前日志准备追加，快照是旧的 JSON 格式时重写一份二进制快照
          * 
          * @return bool 加载成功返回true，失败返回false
          */
         bool InitLoad() 
         {
-            mylog::GetLogger("cloud_storage")->Info("init datamanager");
-            FileUtil f(storage_file_);
-            
-            // 如果持久化文件不存在，说明是首次运行，直接返回成功
-            if (!f.Exists()){
-                mylog::GetLogger("cloud_storage")->Info("there is no storage file info need to load");
-                return true;
-            }
+            Logger()->Info("init datamanager");
+            bool legacy = false;
+            bool ok = LoadSnapshot(&legacy);
 
-            // 读取持久化文件内容
-            std::string body;
-            if (!f.GetContent(&body))
-                return false;
-
-            // JSON反序列化，将文件内容转换为结构化数据
-            Json::Value root;
-            JsonUtil::UnSerialize(body, &root);
-            
-            // 遍历JSON数组，将每条记录恢复到内存哈希表
-            for (int i = 0; i < root.size(); i++)
-            {
+            auto apply = [this](const char *data, size_t len) {
                 StorageInfo info;
-                info.fsize_ = root[i]["fsize_"].asInt();                    // 文件大小
-                info.atime_ = root[i]["atime_"].asInt();                    // 访问时间
-                info.mtime_ = root[i]["mtime_"].asInt();                    // 修改时间
-                info.storage_path_ = root[i]["storage_path_"].asString();   // 存储路径
-                info.url_ = root[i]["url_"].asString();                     // 访问URL
-                Insert(info);  // 插入到内存哈希表
+                if (DecodePut(data, len, &info))
+                    table_.Put(std::move(info));
+            };
+            uint64_t valid = 0;
+            size_t before = table_.Size();
+            if (!MetaJournal::Replay(journal_old_file_, apply, &valid))
+                ok = false;
+            if (!MetaJournal::Replay(journal_file_, apply, &valid))
+            {
+                // 不是日志格式的文件挪开，不能截断覆盖
+                rename(journal_file_.c_str(), (journal_file_ + ".bad").c_str());
+                valid = 0;
+                ok = false;
             }
-            return true;
+            Logger()->Info("metadata loaded: %zu records, %zu from journal",
+                           table_.Size(), table_.Size() - before);
+            if (!journal_.Open(journal_file_, valid,
+                               Config::GetInstance()->GetMetadataFsync()))
+                ok = false;
+            // 旧的 JSON 快照马上换成二进制格式，下次启动直接 mmap
+            if (ok && legacy)
+                ok = Storage();
+            return ok;
         }
 
         /**
-         * 持久化存储 - 将内存数据同步到文件
+         * 持久化存储 - 把内存数据写成一份完整快照，丢弃已经包含在内的日志
          * 
          * 持久化流程：
-         * 1. 获取内存中的所有数据
-         * 2. 将数据序列化为JSON格式
-         * 3. 写入持久化文件
+         * 1. 切换日志
+         * 2. 获取内存中的所有数据，按 URL 排序
+         * 3. 写成二进制索引的临时文件、fsync 后替换快照文件
+         * 4. 删除切换下来的旧日志
+         * 
+         * 代价与文件总数成正比，由定时检查在日志足够长时提交到线程池执行
          * 
          * @return bool 存储成功返回true，失败返回false
          */
         bool Storage()
         {
-            mylog::GetLogger("cloud_storage")->Info("message storage start");
-            
+            Logger()->Info("message storage start");
+            std::lock_guard<std::mutex> lock(persist_mutex_);
+
+            // 上次快照失败留下的旧日志还没进快照，不能被覆盖；这次的快照同样包含它
+            if (!FileUtil(journal_old_file_).Exists() &&
+                !journal_.Rotate(journal_old_file_))
+                return false;
+
             // 获取内存中的所有存储信息
-            std::vector<StorageInfo> arr;
+            std::vector<StorageInfoPtr> arr;
             if (!GetAll(&arr))
             {
-                mylog::GetLogger("cloud_storage")->Warn("GetAll fail,can't get StorageInfo");
+                Logger()->Warn("GetAll fail,can't get StorageInfo");
                 return false;
             }
 
-            // 构建JSON数组，将所有存储信息序列化
-            Json::Value root;
-            for (auto e : arr)
+            // 写成按 URL 排序的二进制索引
+            if (!MetaIndex::Write(storage_file_, &arr))
             {
-                Json::Value item;
-                item["mtime_"] = (Json::Int64)e.mtime_;           // 修改时间
-                item["atime_"] = (Json::Int64)e.atime_;           // 访问时间  
-                item["fsize_"] = (Json::Int64)e.fsize_;           // 文件大小
-                item["url_"] = e.url_.c_str();                    // 访问URL
-                item["storage_path_"] = e.storage_path_.c_str();  // 存储路径
-                root.append(item);  // 添加到JSON数组
+                Logger()->Error("SetContent for StorageInfo Error");
+                return false;
             }
+            const uint64_t bytes = FileUtil(storage_file_).FileSize();
+            snapshot_bytes_ = bytes;
+            remove(journal_old_file_.c_str());
 
-            // 将JSON对象序列化为字符串
-            std::string body;
-            JsonUtil::Serialize(root, &body);
-            mylog::GetLogger("cloud_storage")->Info("new message for StorageInfo:%s", body.c_str());
-
-            // 写入持久化文件
-            FileUtil f(storage_file_);
-            if (f.SetContent(body.c_str(),body.size()) == false)
-                mylog::GetLogger("cloud_storage")->Error("SetContent for StorageInfo Error");
-
-            mylog::GetLogger("cloud_storage")->Info("message storage end");
+            Logger()->Info("message storage end: %zu records, %llu bytes",
+                           arr.size(), (unsigned long long)bytes);
             return true;
         }
 
@@ -183,21 +220,15 @@ namespace storage
          */
         bool Insert(const StorageInfo &info)
         {
-            mylog::GetLogger("cloud_storage")->Info("data_message Insert start");
+            Logger()->Info("data_message Insert start");
             
-            // 获取写锁，确保插入操作的原子性
-            pthread_rwlock_wrlock(&rwlock_);
-            table_[info.url_] = info;  // 以URL为key插入哈希表
-            pthread_rwlock_unlock(&rwlock_);
-            
-            // 如果启用了持久化，立即同步到文件
-            if (need_persist_ == true && Storage() == false)
+            if (!Put(info))
             {
-                mylog::GetLogger("cloud_storage")->Error("data_message Insert:Storage Error");
+                Logger()->Error("data_message Insert:Storage Error");
                 return false;
             }
             
-            mylog::GetLogger("cloud_storage")->Info("data_message Insert end");
+            Logger()->Info("data_message Insert end");
             return true;
         }
 
@@ -209,87 +240,291 @@ namespace storage
          */
         bool Update(const StorageInfo &info)
         {
-            mylog::GetLogger("cloud_storage")->Info("data_message Update start");
+            Logger()->Info("data_message Update start");
             
-            // 获取写锁，确保更新操作的原子性
-            pthread_rwlock_wrlock(&rwlock_);
-            table_[info.url_] = info;  // 更新哈希表中的记录
-            pthread_rwlock_unlock(&rwlock_);
+            if (!Put(info))
+            {
+                Logger()->Error("data_message Update:Storage Error");
+                return false;
+            }
             
-            // 立即持久化更新后的数据
-            if (Storage() == false)
+            Logger()->Info("data_message Update end");
+            return true;
+        }
+        /**
+         * 从 JSON 数组导入存储信息(格式同旧版本的 storage.data)，同 URL 的
+         * 记录被覆盖；只改内存，之后调用 Storage() 写进快照
+         *
+         * @return bool 文件读取失败或者不是 JSON 数组时返回false
+         */
+        bool ImportJson(const std::string &path)
+        {
+            std::string body;
+            if (!FileUtil(path).GetContent(&body))
+                return false;
+
+            // JSON反序列化，将文件内容转换为结构化数据
+            Json::Value root;
+            if (!JsonUtil::UnSerialize(body, &root) || !root.isArray())
             {
-                mylog::GetLogger("cloud_storage")->Error("data_message Update:Storage Error");
+                Logger()->Error("%s is not a json array", path.c_str());
                 return false;
             }
             
-            mylog::GetLogger("cloud_storage")->Info("data_message Update end");
+            // 遍历JSON数组，将每条记录恢复到内存表
+            for (Json::ArrayIndex i = 0; i < root.size(); i++)
+            {
+                StorageInfo info;
+                info.fsize_ = root[i]["fsize_"].asInt64();                  // 文件大小
+                info.atime_ = root[i]["atime_"].asInt64();                  // 访问时间
+                info.mtime_ = root[i]["mtime_"].asInt64();                  // 修改时间
+                info.storage_path_ = root[i]["storage_path_"].asString();   // 存储路径
+                info.url_ = root[i]["url_"].asString();                     // 访问URL
+                table_.Put(std::move(info));  // 插入到内存表
+            }
+            Logger()->Info("imported %u records from %s", root.size(), path.c_str());
             return true;
         }
+
+        /**
+         * 把全部存储信息导出成 JSON 数组，可以再用 ImportJson 导入
+         */
+        bool ExportJson(const std::string &path)
+        {
+            std::vector<StorageInfoPtr> arr;
+            GetAll(&arr);
+
+            // 构建JSON数组，将所有存储信息序列化
+            Json::Value root(Json::arrayValue);
+            for (const auto &e : arr)
+            {
+                Json::Value item;
+                item["mtime_"] = (Json::Int64)e->mtime_;           // 修改时间
+                item["atime_"] = (Json::Int64)e->atime_;           // 访问时间  
+                item["fsize_"] = (Json::Int64)e->fsize_;           // 文件大小
+                item["url_"] = e->url_.c_str();                    // 访问URL
+                item["storage_path_"] = e->storage_path_.c_str();  // 存储路径
+                root.append(item);  // 添加到JSON数组
+            }
+
+            std::string body;
+            JsonUtil::Serialize(root, &body);
+            return FileUtil(path).SetContent(body.c_str(), body.size());
+        }
+
         /**
          * 按URL查询存储信息 - 通过文件访问URL获取存储详情
          * 
          * @param key 文件的访问URL
-         * @param info 输出参数，存储查询到的信息
+         * @param info 输出参数，查询到的记录，之后的更新不影响它
          * @return bool 查询成功返回true，未找到返回false
          */
-        bool GetOneByURL(const std::string &key, StorageInfo *info)
+        bool GetOneByURL(const std::string &key, StorageInfoPtr *info)
         {
-            pthread_rwlock_rdlock(&rwlock_);  // 获取读锁，允许并发读取
-            
-            // 在哈希表中查找URL对应的记录
-            if (table_.find(key) == table_.end())
-            {
-                pthread_rwlock_unlock(&rwlock_);
-                return false;  // 未找到记录
-            }
-            
-            *info = table_[key];  // 复制找到的存储信息
-            pthread_rwlock_unlock(&rwlock_);
-            return true;
+            return table_.FindByUrl(key, info);
         }
         /**
          * 按存储路径查询存储信息 - 通过物理存储路径获取存储详情
          * 
-         * 注意：由于存储路径不是哈希表的key，需要遍历查找，性能相对较低
+         * 存储路径由内存表单独维护索引，不需要遍历
          * 
          * @param storage_path 文件的物理存储路径
-         * @param info 输出参数，存储查询到的信息
+         * @param info 输出参数，查询到的记录
          * @return bool 查询成功返回true，未找到返回false
          */
-        bool GetOneByStoragePath(const std::string &storage_path, StorageInfo *info)
+        bool GetOneByStoragePath(const std::string &storage_path, StorageInfoPtr *info)
         {
-            pthread_rwlock_rdlock(&rwlock_);  // 获取读锁
-            
-            // 遍历哈希表查找匹配的存储路径
-            for (auto e : table_)
-            {
-                if (e.second.storage_path_ == storage_path)
-                {
-                    *info = e.second;  // 找到匹配记录
-                    pthread_rwlock_unlock(&rwlock_);
-                    return true;
-                }
-            }
-            
-            pthread_rwlock_unlock(&rwlock_);
-            return false;  // 未找到匹配记录
+            return table_.FindByPath(storage_path, info);
         }
         /**
-         * 获取所有存储信息 - 返回内存中的全部文件存储记录
+         * 按修改时间查询 - 修改时间在 [from, to] 内的记录，按修改时间升序
+         */
+        bool GetByMtime(time_t from, time_t to, std::vector<StorageInfoPtr> *arry)
+        {
+            table_.RangeByMtime(from, to, arry);
+            return true;
+        }
+        /**
+         * 按文件大小查询 - 大小在 [min, max] 字节内的记录，按大小升序
+         */
+        bool GetBySize(size_t min, size_t max, std::vector<StorageInfoPtr> *arry)
+        {
+            table_.RangeBySize(min, max, arry);
+            return true;
+        }
+        /**
+         * 获取所有存储信息 - 返回内存中的全部文件存储记录，无序
          * 
          * @param arry 输出参数，存储所有存储信息的向量
          * @return bool 始终返回true
          */
-        bool GetAll(std::vector<StorageInfo> *arry)
+        bool GetAll(std::vector<StorageInfoPtr> *arry)
         {
-            pthread_rwlock_rdlock(&rwlock_);  // 获取读锁
-            
-            // 遍历哈希表，将所有存储信息添加到向量中
-            for (auto e : table_)
-                arry->emplace_back(e.second);
-                
-            pthread_rwlock_unlock(&rwlock_);
+            table_.All(arry);
+            return true;
+        }
+
+    private:
+        /**
+         * 改内存表并向日志追加一条记录，日志写坏了时立即提交快照任务
+         *
+         * 先改内存表再写日志，见类注释中的快照流程。记录在 URL 分片的写锁内
+         * 放进日志的待写队列，同一 URL 的并发更新在表中和日志中的先后一致，
+         * 回放得到的就是表中的最后一次更新；等待写盘在锁外进行。
+         */
+        bool Put(const StorageInfo &info)
+        {
+            std::string record;
+            EncodePut(info, &record);
+            uint64_t seq = 0;
+            table_.Put(info, [&](const StorageInfo &) {
+                seq = journal_.Enqueue(record.data(), record.size());
+            });
+            const bool ok = journal_.Wait(seq);
+            // 写坏的日志在换新文件之前一直失败，不等定时检查
+            if (!ok || compact_on_put_)
+                MaybeCompact(!ok);
+            return ok;
+        }
+
+        /**
+         * 日志长度超过上一份快照时提交快照任务，每条记录分摊的快照代价不随
+         * 文件数增长；force 为 true 时不看长度
+         */
+        void MaybeCompact(bool force)
+        {
+            const uint64_t threshold = std::max<uint64_t>(compact_bytes_, snapshot_bytes_);
+            if (!force && journal_.Bytes() < threshold)
+                return;
+            if (compacting_.exchange(true))
+                return;
+            auto job = [this]() {
+                Storage();
+                compacting_ = false;
+            };
+            static const ThreadPool::ClassId cls =
+                tp != nullptr ? tp->findClass("bulk") : ThreadPool::kDefaultClass;
+            if (tp == nullptr)
+                job();
+            else if (!tp->postTo(cls, job))
+                compacting_ = false;
+        }
+
+        /**
+         * 每隔 interval_ms 在线程池中检查一次日志长度，插入路径上不再做检查；
+         * 没有线程池或 interval_ms 为 0 时退回每次插入后检查。本对象析构后
+         * 由定时任务自己取消
+         */
+        void ScheduleCompactCheck(uint64_t interval_ms)
+        {
+            if (tp == nullptr || interval_ms == 0)
+                return;
+            compact_timer_ = std::make_shared<CompactTimer>();
+            compact_timer_->owner = this;
+            auto timer = compact_timer_;
+            timer->id = tp->scheduleEvery(
+                std::chrono::milliseconds(interval_ms), [timer]() {
+                    std::lock_guard<std::mutex> lock(timer->mutex);
+                    if (timer->owner == nullptr)
+                        tp->cancelTimer(timer->id);
+                    else
+                        timer->owner->MaybeCompact(false);
+                });
+            compact_on_put_ = false;
+        }
+
+        // 加载快照，文件不存在说明是首次运行；legacy 输出是否为 JSON 快照
+        bool LoadSnapshot(bool *legacy)
+        {
+            FileUtil f(storage_file_);
+            if (!f.Exists())
+            {
+                Logger()->Info("there is no storage file info need to load");
+                return true;
+            }
+            snapshot_bytes_ = f.FileSize();
+            if (!MetaIndex::Detect(storage_file_))
+            {
+                Logger()->Info("%s is json, import it", storage_file_.c_str());
+                *legacy = true;
+                return ImportJson(storage_file_);
+            }
+
+            MetaIndex index;
+            if (!index.Open(storage_file_, true))
+                return false;
+            // 一次扫描批量装进内存表，先按记录数预留桶
+            uint64_t bad = 0, i = 0;
+            table_.Reserve(index.Count());
+            table_.Load([&](StorageInfo *info) {
+                MetaIndex::Entry entry;
+                for (; i < index.Count(); ++i)
+                {
+                    if (!index.At(i, &entry))
+                    {
+                        bad++;
+                        continue;
+                    }
+                    info->url_.assign(entry.url);
+                    info->storage_path_.assign(entry.storage_path);
+                    info->mtime_ = entry.mtime;
+                    info->atime_ = entry.atime;
+                    info->fsize_ = entry.fsize;
+                    ++i;
+                    return true;
+                }
+                return false;
+            });
+            if (bad > 0)
+                Logger()->Error("%s: %llu bad records", storage_file_.c_str(),
+                                (unsigned long long)bad);
+            return true;
+        }
+
+        // 日志记录：u8 类型，i64 mtime，i64 atime，u64 fsize，
+        // u32 长度 + URL，u32 长度 + 存储路径
+        static void EncodePut(const StorageInfo &info, std::string *out)
+        {
+            const int64_t mtime = info.mtime_, atime = info.atime_;
+            const uint64_t fsize = info.fsize_;
+            const uint32_t url_len = info.url_.size();
+            const uint32_t path_len = info.storage_path_.size();
+            out->push_back(static_cast<char>(kRecordPut));
+            out->append(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+            out->append(reinterpret_cast<const char *>(&atime), sizeof(atime));
+            out->append(reinterpret_cast<const char *>(&fsize), sizeof(fsize));
+            out->append(reinterpret_cast<const char *>(&url_len), sizeof(url_len));
+            out->append(info.url_);
+            out->append(reinterpret_cast<const char *>(&path_len), sizeof(path_len));
+            out->append(info.storage_path_);
+        }
+
+        static bool DecodePut(const char *data, size_t len, StorageInfo *info)
+        {
+            int64_t mtime, atime;
+            uint64_t fsize;
+            uint32_t url_len, path_len;
+            const size_t fixed = 1 + sizeof(mtime) + sizeof(atime) + sizeof(fsize);
+            if (len < fixed + sizeof(url_len) || data[0] != kRecordPut)
+                return false;
+            memcpy(&mtime, data + 1, sizeof(mtime));
+            memcpy(&atime, data + 1 + sizeof(mtime), sizeof(atime));
+            memcpy(&fsize, data + 1 + sizeof(mtime) + sizeof(atime), sizeof(fsize));
+            size_t pos = fixed;
+            memcpy(&url_len, data + pos, sizeof(url_len));
+            pos += sizeof(url_len);
+            if (len < pos + url_len + sizeof(path_len))
+                return false;
+            info->url_.assign(data + pos, url_len);
+            pos += url_len;
+            memcpy(&path_len, data + pos, sizeof(path_len));
+            pos += sizeof(path_len);
+            if (len < pos + path_len)
+                return false;
+            info->storage_path_.assign(data + pos, path_len);
+            info->mtime_ = mtime;
+            info->atime_ = atime;
+            info->fsize_ = fsize;
             return true;
         }
     }; // namespace DataManager
@@ -0,0 +1,420 @@
+#pragma once
+#include "Offload.hpp"
+#include "Util.hpp"
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/http.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <zstd.h>
+
+namespace storage {
+/**
+ * 文件下载：普通文件零拷贝发送，深度存储文件流式解压发送
+ *
+ * 回复由若干段组成，每段是一段原始数据 [begin, begin + length)，前面可以
+ * 带一个分段头(multipart/byteranges 的分隔行和头部)，全部之后可以再带一个
+ * 结尾；整个文件就是一段不带分段头的 {0, kAll}。
+ *
+ * 普通文件用 evbuffer_file_segment 按段加入回复，输出缓冲区标记为直接写
+ * fd，由 sendfile 发送，不经过用户态。
+ *
+ * 压缩文件每次在线程池中解压出一块(kChunkSize)，回到事件循环线程放进
+ * 回复，等这一块写进 socket 后(evhttp_send_reply_chunk_with_cb 的回调)
+ * 再解压下一块，内存占用与文件大小无关，首字节时间也与文件大小无关。原始大小已知(seekable
+ * 格式的跳转表或单帧的帧头)时用 Content-Length 回复，否则用 chunked
+ * 传输编码。seekable 格式的文件每段从覆盖起点的帧开始解压，代价与这一段
+ * 的长度成正比；旧的单帧文件只能顺序解压并丢弃不需要的部分。
+ * 连接中途断开时由 evhttp 的关闭回调释放，正在解压时等解压任务回来再释放。
+ */
+class DownloadStream {
+  public:
+    static constexpr uint64_t kAll = UINT64_MAX;
+    struct Part {
+        std::string head; // 分段头，单段回复为空
+        uint64_t begin;
+        uint64_t length; // kAll 表示到结尾
+    };
+
+    /**
+     * 打开压缩文件、读出开头并判断格式，在线程池中调用，结果交给 Send，
+     * 文件只打开一次，跳转表只解析一次
+     * @param size 解压后的大小，不是 zstd 帧的文件为文件大小
+     * @param size_known 输出参数，帧头没有记录原始大小时为 false
+     * @return 打不开或者读失败时返回 nullptr
+     */
+    static std::unique_ptr<DownloadStream> Prepare(const std::string &path,
+                                                   uint64_t *size,
+                                                   bool *size_known) {
+        std::unique_ptr<DownloadStream> stream(new DownloadStream(nullptr));
+        if (!stream->Open(path) || !stream->Read())
+            return nullptr;
+        uint64_t probed = kAll;
+        stream->format_ = stream->Probe(&probed);
+        stream->size_ = probed;
+        *size_known = stream->format_ != Format::kUnknown;
+        if (*size_known)
+            *size = probed;
+        return stream;
+    }
+
+    /**
+     * 用 sendfile 发送已打开的普通文件中的若干段，调用前设置好响应头
+     * fd 由回复接管，发送完后关闭
+     */
+    static void SendFile(evhttp_request *req, const int fd,
+                         const uint64_t file_size, const int code,
+                         const char *reason,
+                         const std::vector<Part> &parts = {{"", 0, kAll}},
+                         const std::string &tail = "") {
+        AddFile(req, fd, file_size, parts, tail);
+        evhttp_send_reply(req, code, reason, nullptr);
+    }
+
+    /**
+     * 开始发送 Prepare 得到的 stream 解压后的若干段，调用前设置好响应头
+     * stream 由回复接管；每一块的解压在线程池中执行，完成后回到事件循环
+     * 线程发送。stream 为空(文件打不开)时回复 500
+     */
+    static void Send(evhttp_request *req, std::unique_ptr<DownloadStream> stream,
+                     const int code, const char *reason,
+                     const std::vector<Part> &parts = {{"", 0, kAll}},
+                     const std::string &tail = "") {
+        if (stream == nullptr) {
+            Logger()->Info("evhttp_send_reply: 500 - open failed");
+            evhttp_send_reply(req, HTTP_INTERNAL, nullptr, nullptr);
+            return;
+        }
+        auto *self = stream.release();
+        self->req_ = req;
+        self->evcon_ = evhttp_request_get_connection(req);
+        self->code_ = code;
+        self->reason_ = reason != nullptr ? reason : "";
+        self->parts_ = parts;
+        self->tail_ = tail;
+        self->Start();
+    }
+    ~DownloadStream() {
+        if (fd_ >= 0)
+            close(fd_);
+        ZSTD_freeDCtx(dctx_);
+    }
+
+  private:
+    static constexpr size_t kChunkSize = 256 * 1024;
+    enum class Produced { kMore, kLast, kError };
+    enum class Format {
+        kSeekable, // 带跳转表的多帧文件
+        kFrame,    // 帧头记录了原始大小的单帧文件
+        kUnknown,  // zstd 帧，但原始大小未知
+        kRaw,      // 不是 zstd 帧
+    };
+
+    explicit DownloadStream(evhttp_request *req)
+        : req_(req),
+          evcon_(req ? evhttp_request_get_connection(req) : nullptr),
+          dctx_(ZSTD_createDCtx()), in_buf_(ZSTD_DStreamInSize()) {}
+
+    static void AddFile(evhttp_request *req, const int fd,
+                        const uint64_t file_size,
+                        const std::vector<Part> &parts,
+                        const std::string &tail) {
+        evbuffer *outbuf = evhttp_request_get_output_buffer(req);
+        // 没有这个标记时 libevent 会把文件段 mmap 进来，而不是用 sendfile
+        evbuffer_set_flags(outbuf, EVBUFFER_FLAG_DRAINS_TO_FD);
+        evbuffer_file_segment *seg = evbuffer_file_segment_new(
+            fd, 0, file_size, EVBUF_FS_CLOSE_ON_FREE);
+        if (seg == nullptr) {
+            Logger()->Error("evbuffer_file_segment_new: %d -- %s", fd,
+                            strerror(errno));
+            close(fd);
+            return;
+        }
+        for (const auto &part : parts) {
+            const uint64_t begin = std::min(part.begin, file_size);
+            const uint64_t length = std::min(part.length, file_size - begin);
+            evbuffer_add(outbuf, part.head.data(), part.head.size());
+            if (length > 0 &&
+                evbuffer_add_file_segment(outbuf, seg, begin, length) != 0)
+                Logger()->Error("evbuffer_add_file_segment: %d -- %s", fd,
+                                strerror(errno));
+        }
+        evbuffer_add(outbuf, tail.data(), tail.size());
+        // 回复缓冲区持有文件段的引用，发送完后关闭 fd
+        evbuffer_file_segment_free(seg);
+        // HEAD 请求 evhttp 不发正文，也就不会自动补 Content-Length
+        evhttp_add_header(
+            evhttp_request_get_output_headers(req), "Content-Length",
+            std::to_string(evbuffer_get_length(outbuf)).c_str());
+    }
+
+    bool Open(const std::string &path) {
+        path_ = path;
+        fd_ = open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            Logger()->Error("open file error: %s -- %s", path.c_str(),
+                            strerror(errno));
+            return false;
+        }
+        return dctx_ != nullptr;
+    }
+
+    // 判断文件格式，得到解压后的大小(kRaw 时为文件大小)
+    Format Probe(uint64_t *size) {
+        const uint64_t file_size = FileUtil(path_).FileSize();
+        if (table_.Load(fd_, file_size)) {
+            seekable_ = true;
+            *size = table_.Size();
+            return Format::kSeekable;
+        }
+        const unsigned long long frame_size =
+            ZSTD_getFrameContentSize(in_buf_.data(), in_.size);
+        if (frame_size == ZSTD_CONTENTSIZE_ERROR) {
+            *size = file_size;
+            return Format::kRaw;
+        }
+        if (frame_size == ZSTD_CONTENTSIZE_UNKNOWN)
+            return Format::kUnknown;
+        *size = frame_size;
+        return Format::kFrame;
+    }
+
+    bool Read() {
+        ssize_t n;
+        do {
+            n = read(fd_, in_buf_.data(), in_buf_.size());
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            Logger()->Error("read %s failed: %s", path_.c_str(),
+                            strerror(errno));
+            return false;
+        }
+        in_ = {in_buf_.data(), static_cast<size_t>(n), 0};
+        eof_ = n == 0;
+        return true;
+    }
+
+    /**
+     * 把解压位置移到原始偏移 begin
+     * seekable 格式跳到覆盖 begin 的帧；单帧文件向后移动时继续解压并丢弃，
+     * 向前移动时只能从头开始
+     */
+    bool Seek(const uint64_t begin) {
+        uint64_t from = out_pos_;
+        if (seekable_ || begin < out_pos_) {
+            from = 0;
+            uint64_t offset = 0;
+            if (seekable_) {
+                const auto frame = table_.Locate(begin);
+                offset = frame.compressed_offset;
+                from = frame.decompressed_offset;
+            }
+            if (lseek(fd_, offset, SEEK_SET) < 0) {
+                Logger()->Error("lseek %s failed: %s", path_.c_str(),
+                                strerror(errno));
+                return false;
+            }
+            ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+            in_ = {in_buf_.data(), 0, 0};
+            eof_ = false;
+            out_full_ = false;
+            pending_ = 0;
+            out_pos_ = from;
+        }
+        skip_ = begin - from;
+        return true;
+    }
+
+    /**
+     * 解压出最多 kChunkSize 字节追加到 chunk
+     * @param done 要发送的内容已经全部解压完
+     */
+    bool Produce(evbuffer *chunk, bool *done) {
+        while (evbuffer_get_length(chunk) < kChunkSize) {
+            if (remaining_ == 0) {
+                if (next_part_ == parts_.size()) {
+                    evbuffer_add(chunk, tail_.data(), tail_.size());
+                    *done = true;
+                    return true;
+                }
+                const Part &part = parts_[next_part_++];
+                evbuffer_add(chunk, part.head.data(), part.head.size());
+                remaining_ = part.length;
+                if (!Seek(part.begin))
+                    return false;
+                continue;
+            }
+            if (in_.pos == in_.size && !out_full_) {
+                if (!eof_ && !Read())
+                    return false;
+                if (eof_) {
+                    // 帧还没结束或者内容不够长文件就读完了，说明压缩文件被截断
+                    if (pending_ != 0 || remaining_ != kAll) {
+                        Logger()->Error("%s: truncated zstd frame",
+                                        path_.c_str());
+                        return false;
+                    }
+                    remaining_ = 0;
+                    continue;
+                }
+            }
+            evbuffer_iovec vec;
+            if (evbuffer_reserve_space(chunk, ZSTD_DStreamOutSize(), &vec,
+                                       1) < 1)
+                return false;
+            ZSTD_outBuffer out = {vec.iov_base, vec.iov_len, 0};
+            const size_t ret = ZSTD_decompressStream(dctx_, &out, &in_);
+            if (ZSTD_isError(ret)) {
+                Logger()->Error("%s: %s", path_.c_str(),
+                                ZSTD_getErrorName(ret));
+                return false;
+            }
+            pending_ = ret;
+            out_pos_ += out.pos;
+            // 输出缓冲区被填满时解压器里可能还有数据，输入用完也要继续调用
+            out_full_ = out.pos == out.size;
+            // 丢掉起点之前的部分，截掉终点之后的部分
+            const size_t drop = std::min<uint64_t>(skip_, out.pos);
+            size_t keep = out.pos - drop;
+            skip_ -= drop;
+            if (drop > 0 && keep > 0)
+                memmove(vec.iov_base, static_cast<char *>(vec.iov_base) + drop,
+                        keep);
+            keep = std::min<uint64_t>(keep, remaining_);
+            if (remaining_ != kAll)
+                remaining_ -= keep;
+            vec.iov_len = keep;
+            evbuffer_commit_space(chunk, &vec, 1);
+        }
+        return true;
+    }
+
+    // 文件已打开并判断了格式，在事件循环线程中发出响应头
+    void Start() {
+        if (format_ == Format::kRaw) {
+            // 不是 zstd 帧，原样发送(和原来 unpack 的处理一致)
+            Logger()->Warn("%s is not a zstd frame, send as is", path_.c_str());
+            AddFile(req_, fd_, size_, parts_, tail_);
+            fd_ = -1; // 文件段接管了 fd
+            evhttp_send_reply(req_, code_, reason_.c_str(), nullptr);
+            delete this;
+            return;
+        }
+        if (format_ != Format::kUnknown) {
+            uint64_t total = tail_.size();
+            for (auto &part : parts_) {
+                part.begin = std::min(part.begin, size_);
+                part.length = std::min(part.length, size_ - part.begin);
+                total += part.head.size() + part.length;
+            }
+            evhttp_add_header(evhttp_request_get_output_headers(req_),
+                              "Content-Length", std::to_string(total).c_str());
+        }
+        if (evhttp_request_get_command(req_) == EVHTTP_REQ_HEAD) {
+            evhttp_send_reply(req_, code_, reason_.c_str(), nullptr);
+            delete this;
+            return;
+        }
+        evhttp_send_reply_start(req_, code_, reason_.c_str());
+        evhttp_connection_set_closecb(evcon_, &DownloadStream::OnClose, this);
+        Next();
+    }
+
+    // 在线程池中解压下一块，完成后回到事件循环线程发送
+    void Next() {
+        busy_ = true;
+        evbuffer *chunk = evbuffer_new();
+        Offload::Bulk(
+            [this, chunk]() {
+                bool done = false;
+                if (!Produce(chunk, &done))
+                    return Produced::kError;
+                return done ? Produced::kLast : Produced::kMore;
+            },
+            [this, chunk](Produced result) { SendChunk(chunk, result); });
+    }
+
+    void SendChunk(evbuffer *chunk, const Produced result) {
+        busy_ = false;
+        if (closed_ || result == Produced::kError) {
+            evbuffer_free(chunk);
+            if (closed_)
+                delete this; // 解压期间连接已断开
+            else
+                Abort();
+            return;
+        }
+        if (result == Produced::kMore) {
+            evhttp_send_reply_chunk_with_cb(req_, chunk,
+                                            &DownloadStream::OnSent, this);
+            evbuffer_free(chunk);
+            return;
+        }
+        evhttp_send_reply_chunk(req_, chunk);
+        evbuffer_free(chunk);
+        evhttp_connection_set_closecb(evcon_, nullptr, nullptr);
+        evhttp_send_reply_end(req_);
+        delete this;
+    }
+
+    /**
+     * 响应头已经发出，无法再改成错误码，直接关闭 socket 让客户端知道
+     * 内容不完整；evhttp 发现连接断开后通过关闭回调释放本对象
+     */
+    void Abort() {
+        const evutil_socket_t fd =
+            bufferevent_getfd(evhttp_connection_get_bufferevent(evcon_));
+        if (fd >= 0)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+    static void OnSent(evhttp_connection *, void *arg) {
+        static_cast<DownloadStream *>(arg)->Next();
+    }
+    static void OnClose(evhttp_connection *evcon, void *arg) {
+        auto *self = static_cast<DownloadStream *>(arg);
+        Logger()->Info("download of %s interrupted", self->path_.c_str());
+        evhttp_connection_set_closecb(evcon, nullptr, nullptr);
+        // 回复还没结束时 evhttp 把请求从连接上摘下来而不释放，由这里释放
+        if (evhttp_request_get_connection(self->req_) == nullptr)
+            evhttp_request_free(self->req_);
+        // 线程池正在解压时等它回来再释放
+        if (self->busy_)
+            self->closed_ = true;
+        else
+            delete self;
+    }
+
+    evhttp_request *req_;
+    evhttp_connection *evcon_;
+    ZSTD_DCtx *dctx_;
+    std::vector<char> in_buf_;
+    ZSTD_inBuffer in_ = {nullptr, 0, 0};
+    std::string path_;
+    zstd_wrapper::SeekTable table_;
+    bool seekable_ = false;
+    std::vector<Part> parts_;
+    std::string tail_;
+    size_t next_part_ = 0;
+    uint64_t out_pos_ = 0;   // 解压器下一个输出字节的原始偏移
+    uint64_t skip_ = 0;      // 起点之前还要丢弃的解压字节数
+    uint64_t remaining_ = 0; // 当前段还要发送的字节数，0 时开始下一段
+    int fd_ = -1;
+    bool eof_ = false;
+    bool out_full_ = false;
+    size_t pending_ = 0; // ZSTD_decompressStream 的返回值，0 表示帧已结束
+    int code_ = HTTP_OK;
+    std::string reason_;
+    Format format_ = Format::kUnknown;
+    uint64_t size_ = kAll; // Probe 得到的大小
+    bool busy_ = false;    // 线程池中有本对象的解压任务
+    bool closed_ = false;  // 解压期间连接已断开
+};
+} // namespace storage
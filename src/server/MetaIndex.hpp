@@ -0,0 +1,285 @@
+#pragma once
+#include "Util.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace storage {
+/**
+ * 元数据快照的二进制格式，可以 mmap 后直接查询
+ *
+ *   [Header 64 字节][Record * count，按 URL 字节序排序][字符串堆]
+ *
+ * Record 定长，URL 和存储路径存成字符串堆中的 (偏移, 长度)，所以打开
+ * 只需要 mmap 和检查文件头，代价与记录数无关：Find 在记录数组上二分
+ * 查找，At 按下标取，返回的 string_view 直接指向映射的内存；也可以
+ * 顺序扫一遍整体装进哈希表。数值按本机字节序(小端)存放。
+ *
+ * Write 写临时文件、fsync 后 rename，再 fsync 所在目录，文件要么是旧的
+ * 要么是完整的新文件，所以不做整体校验，只检查偏移不越界。
+ */
+class MetaIndex {
+  public:
+    static constexpr char kMagic[8] = {'S', 'M', 'E', 'T', 'A', 'I', 'D', 'X'};
+    static constexpr uint32_t kVersion = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t count;
+        uint64_t records_offset;
+        uint64_t heap_offset;
+        uint64_t heap_size;
+        char reserved[16];
+    };
+    struct Record {
+        int64_t mtime;
+        int64_t atime;
+        uint64_t fsize;
+        uint64_t url_off; // 相对字符串堆起点
+        uint64_t path_off;
+        uint32_t url_len;
+        uint32_t path_len;
+    };
+    static_assert(sizeof(Header) == 64 && sizeof(Record) == 48,
+                  "on-disk layout");
+
+    // 映射内存中的一条记录，Close 之前有效
+    struct Entry {
+        std::string_view url;
+        std::string_view storage_path;
+        int64_t mtime;
+        int64_t atime;
+        uint64_t fsize;
+    };
+
+    MetaIndex() = default;
+    ~MetaIndex() { Close(); }
+    MetaIndex(const MetaIndex &) = delete;
+    MetaIndex &operator=(const MetaIndex &) = delete;
+
+    // 文件开头是不是这个格式，用来区分旧的 JSON 快照
+    static bool Detect(const std::string &path) {
+        char magic[sizeof(kMagic)];
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        const bool ok = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                        memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+        close(fd);
+        return ok;
+    }
+
+    // sequential 为 true 表示打开后要顺序扫一遍，让内核提前读
+    bool Open(const std::string &path, const bool sequential = false) {
+        Close();
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+            close(fd);
+            return false;
+        }
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        base_ = static_cast<const char *>(map);
+        size_ = st.st_size;
+        header_ = reinterpret_cast<const Header *>(base_);
+        // 先确认偏移和记录数落在文件内再相加，损坏的头部不会让计算溢出
+        const bool records_ok =
+            header_->records_offset >= sizeof(Header) &&
+            header_->records_offset <= size_ &&
+            header_->records_offset % alignof(Record) == 0 &&
+            header_->count <= (size_ - header_->records_offset) / sizeof(Record);
+        const uint64_t records_end =
+            records_ok ? header_->records_offset + header_->count * sizeof(Record)
+                       : 0;
+        if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+            header_->version != kVersion ||
+            header_->record_size != sizeof(Record) || !records_ok ||
+            header_->heap_offset < records_end || header_->heap_offset > size_ ||
+            header_->heap_size > size_ - header_->heap_offset) {
+            Logger()->Error("%s: bad metadata index", path.c_str());
+            Close();
+            return false;
+        }
+        records_ = reinterpret_cast<const Record *>(base_ +
+                                                    header_->records_offset);
+        heap_ = base_ + header_->heap_offset;
+        if (sequential)
+            madvise(const_cast<char *>(base_), size_, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void Close() {
+        if (base_ != nullptr)
+            munmap(const_cast<char *>(base_), size_);
+        base_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+        records_ = nullptr;
+        heap_ = nullptr;
+    }
+
+    uint64_t Count() const { return header_ == nullptr ? 0 : header_->count; }
+
+    // 第 i 条记录，偏移越界时返回 false
+    bool At(const uint64_t i, Entry *entry) const {
+        const Record &r = records_[i];
+        const uint64_t heap = header_->heap_size;
+        if (r.url_off > heap || r.url_len > heap - r.url_off ||
+            r.path_off > heap || r.path_len > heap - r.path_off)
+            return false;
+        entry->url = std::string_view(heap_ + r.url_off, r.url_len);
+        entry->storage_path = std::string_view(heap_ + r.path_off, r.path_len);
+        entry->mtime = r.mtime;
+        entry->atime = r.atime;
+        entry->fsize = r.fsize;
+        return true;
+    }
+
+    // 按 URL 二分查找
+    bool Find(const std::string_view url, Entry *entry) const {
+        uint64_t lo = 0, hi = Count();
+        while (lo < hi) {
+            const uint64_t mid = lo + (hi - lo) / 2;
+            if (!At(mid, entry))
+                return false;
+            const int cmp = entry->url.compare(url);
+            if (cmp == 0)
+                return true;
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    /**
+     * 把 entries 写成索引文件，entries 会按 URL 排序
+     * 元素是 Info 或者 shared_ptr<const Info>，Info 需要有 url_、
+     * storage_path_、mtime_、atime_、fsize_ 成员
+     */
+    template <typename Elem>
+    static bool Write(const std::string &path, std::vector<Elem> *entries) {
+        std::sort(entries->begin(), entries->end(),
+                  [](const Elem &a, const Elem &b) {
+                      return Deref(a).url_ < Deref(b).url_;
+                  });
+        Header header{};
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.record_size = sizeof(Record);
+        header.count = entries->size();
+        header.records_offset = sizeof(Header);
+        header.heap_offset = sizeof(Header) + entries->size() * sizeof(Record);
+        for (const auto &elem : *entries) {
+            const auto &e = Deref(elem);
+            header.heap_size += e.url_.size() + e.storage_path_.size();
+        }
+
+        const std::string tmp = path + ".tmp";
+        const int fd =
+            open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            Logger()->Error("open %s failed: %s", tmp.c_str(), strerror(errno));
+            return false;
+        }
+        Writer out(fd);
+        out.Append(&header, sizeof(header));
+        uint64_t heap_off = 0;
+        for (const auto &elem : *entries) {
+            const auto &e = Deref(elem);
+            Record r{};
+            r.mtime = e.mtime_;
+            r.atime = e.atime_;
+            r.fsize = e.fsize_;
+            r.url_off = heap_off;
+            r.url_len = e.url_.size();
+            r.path_off = heap_off + e.url_.size();
+            r.path_len = e.storage_path_.size();
+            heap_off += e.url_.size() + e.storage_path_.size();
+            out.Append(&r, sizeof(r));
+        }
+        for (const auto &elem : *entries) {
+            const auto &e = Deref(elem);
+            out.Append(e.url_.data(), e.url_.size());
+            out.Append(e.storage_path_.data(), e.storage_path_.size());
+        }
+        bool ok = out.Flush() && fsync(fd) == 0;
+        close(fd);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            Logger()->Error("write %s failed: %s", path.c_str(),
+                            strerror(errno));
+            remove(tmp.c_str());
+            return false;
+        }
+        const std::string dir = fs::path(path).parent_path().string();
+        const int dir_fd = open(dir.empty() ? "." : dir.c_str(),
+                                O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+        return true;
+    }
+
+  private:
+    template <typename Info>
+    static const Info &Deref(const Info &info) {
+        return info;
+    }
+    template <typename Info>
+    static const Info &Deref(const std::shared_ptr<const Info> &info) {
+        return *info;
+    }
+
+    // 攒满 1MB 再 write，记录很多时避免逐条系统调用
+    class Writer {
+      public:
+        explicit Writer(const int fd) : fd_(fd) { buf_.reserve(kBufSize); }
+        void Append(const void *data, const size_t len) {
+            if (buf_.size() + len > kBufSize)
+                Flush();
+            buf_.append(static_cast<const char *>(data), len);
+        }
+        bool Flush() {
+            for (size_t off = 0; ok_ && off < buf_.size();) {
+                const ssize_t n = write(fd_, buf_.data() + off, buf_.size() - off);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ok_ = n > 0;
+                off += ok_ ? n : 0;
+            }
+            buf_.clear();
+            return ok_;
+        }
+
+      private:
+        static constexpr size_t kBufSize = 1 << 20;
+        int fd_;
+        bool ok_ = true;
+        std::string buf_;
+    };
+
+    const char *base_ = nullptr;
+    uint64_t size_ = 0;
+    const Header *header_ = nullptr;
+    const Record *records_ = nullptr;
+    const char *heap_ = nullptr;
+};
+} // namespace storage
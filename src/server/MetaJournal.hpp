@@ -0,0 +1,261 @@
+#pragma once
+#include "Util.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace storage {
+/**
+ * 只追加的元数据日志
+ *
+ * 文件以 8 字节头(kMagic + kVersion)开始，之后每条记录是
+ * [u32 长度][u32 校验和][内容]，内容由调用者编码。写到一半崩溃留下的
+ * 不完整或校验不过的尾部在回放时丢弃，重新打开时截掉。
+ *
+ * Append 是组提交：记录先放进内存中的待写缓冲区，第一个等待的线程成为
+ * leader，把此刻积攒的所有记录一次 write、一次 fdatasync，其余线程等它
+ * 完成。并发插入越多，每条记录分摊的 fsync 越少。
+ *
+ * 一次写失败后文件尾部可能留下半条记录，之后追加的记录回放时读不到，
+ * 所以之后的 Append 都返回失败，直到 Rotate 换成新文件；调用者应尽快
+ * 做一次快照，内存中的数据由快照保存。
+ */
+class MetaJournal {
+  public:
+    static constexpr uint32_t kMagic = 0x4c4e4a4d; // "MJNL"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kHeaderSize = 8;
+    static constexpr uint32_t kMaxRecord = 1 << 20;
+
+    MetaJournal() = default;
+    ~MetaJournal() {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+    MetaJournal(const MetaJournal &) = delete;
+    MetaJournal &operator=(const MetaJournal &) = delete;
+
+    /**
+     * 依次对 path 中每条完整的记录调用 apply(const char *data, size_t len)
+     * @param valid 输出参数，最后一条完整记录之后的偏移，文件不存在或不完整
+     *              的文件头时为 0
+     * @return 文件头不对时返回 false；文件不存在、读到损坏的尾部返回 true
+     */
+    template <typename Apply>
+    static bool Replay(const std::string &path, Apply &&apply,
+                       uint64_t *valid) {
+        *valid = 0;
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open())
+            return true;
+        uint32_t head[2];
+        // 建好文件还没写完文件头就崩溃了，当作空日志
+        if (!ifs.read(reinterpret_cast<char *>(head), sizeof(head)))
+            return true;
+        if (head[0] != kMagic || head[1] != kVersion) {
+            Logger()->Warn("%s is not a metadata journal", path.c_str());
+            return false;
+        }
+        uint64_t offset = kHeaderSize;
+        std::string payload;
+        uint32_t frame[2];
+        while (ifs.read(reinterpret_cast<char *>(frame), sizeof(frame))) {
+            if (frame[0] > kMaxRecord)
+                break;
+            payload.resize(frame[0]);
+            if (!ifs.read(&payload[0], frame[0]) ||
+                Checksum(payload.data(), payload.size()) != frame[1])
+                break;
+            apply(payload.data(), payload.size());
+            offset += sizeof(frame) + frame[0];
+        }
+        *valid = offset;
+        return true;
+    }
+
+    /**
+     * 打开日志准备追加，valid 为 Replay 得到的有效长度，之后的内容被截掉
+     * @param sync 每批记录写完后是否 fdatasync
+     */
+    bool Open(const std::string &path, const uint64_t valid, const bool sync) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        sync_ = sync;
+        return Reopen(valid);
+    }
+
+    /**
+     * 追加一条记录，返回时已写进文件(sync 时已落盘)
+     */
+    bool Append(const char *data, const uint32_t len) {
+        return Wait(Enqueue(data, len));
+    }
+
+    /**
+     * 把记录放进待写缓冲区，不等待写出；记录在文件中的顺序就是 Enqueue
+     * 的顺序。调用者可以在自己的锁内 Enqueue、锁外 Wait
+     * @return 记录序号，日志不可写时返回 0
+     */
+    uint64_t Enqueue(const char *data, const uint32_t len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0 || broken_)
+            return 0;
+        const uint32_t frame[2] = {len, Checksum(data, len)};
+        pending_.append(reinterpret_cast<const char *>(frame), sizeof(frame));
+        pending_.append(data, len);
+        return ++appended_;
+    }
+
+    // 等待 Enqueue 返回的记录写完，写失败或 seq 为 0 时返回 false
+    bool Wait(const uint64_t seq) {
+        if (seq == 0)
+            return false;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (done_ < seq) {
+            if (flushing_)
+                cond_.wait(lock);
+            else
+                Flush(lock);
+        }
+        return !Failed(seq);
+    }
+
+    /**
+     * 把当前日志改名为 old_path，之后的记录写进新的空日志
+     * 改名前已 Enqueue 的记录都在旧日志里
+     */
+    bool Rotate(const std::string &old_path) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Flush 写盘时会放开锁，期间新 Enqueue 的记录留在 pending_ 里，
+        // 要一直刷到既没有在写的批次也没有待写的记录才能关闭旧文件
+        while (flushing_ || !pending_.empty()) {
+            if (flushing_)
+                cond_.wait(lock);
+            else
+                Flush(lock);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        if (rename(path_.c_str(), old_path.c_str()) != 0 && errno != ENOENT) {
+            Logger()->Error("rename %s failed: %s", path_.c_str(),
+                            strerror(errno));
+            Reopen(kHeaderSize + bytes_);
+            return false;
+        }
+        return Reopen(0);
+    }
+
+    // 当前日志中记录的字节数(不含文件头)
+    uint64_t Bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    // FNV-1a，只用来识别写坏的尾部
+    static uint32_t Checksum(const char *data, const size_t len) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+  private:
+    // 调用者持有 mutex_；valid 为 0 时新建文件
+    bool Reopen(const uint64_t valid) {
+        broken_ = false;
+        bytes_ = 0;
+        fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            Logger()->Error("open %s failed: %s", path_.c_str(),
+                            strerror(errno));
+            return false;
+        }
+        if (valid >= kHeaderSize) {
+            if (ftruncate(fd_, valid) != 0 || lseek(fd_, valid, SEEK_SET) < 0)
+                broken_ = true;
+            bytes_ = valid - kHeaderSize;
+        } else {
+            const uint32_t head[2] = {kMagic, kVersion};
+            broken_ = ftruncate(fd_, 0) != 0 ||
+                      write(fd_, head, sizeof(head)) != sizeof(head) ||
+                      (sync_ && fdatasync(fd_) != 0);
+        }
+        if (broken_)
+            Logger()->Error("prepare %s failed: %s", path_.c_str(),
+                            strerror(errno));
+        return !broken_;
+    }
+
+    // 调用者持有 mutex_。失败的序号是少数几段连续区间，通常为空
+    bool Failed(const uint64_t seq) const {
+        for (auto it = failed_.rbegin(); it != failed_.rend(); ++it)
+            if (seq >= it->first && seq <= it->second)
+                return true;
+        return false;
+    }
+
+    // 调用者持有 mutex_，写出时暂时释放
+    void Flush(std::unique_lock<std::mutex> &lock) {
+        flushing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        const uint64_t first = done_ + 1, last = appended_;
+        const int fd = fd_;
+        // 已经写坏的文件不再写，这一批直接算失败
+        const bool was_broken = broken_ || fd < 0;
+        bool ok = !was_broken;
+        lock.unlock();
+        for (size_t off = 0; ok && off < batch.size();) {
+            const ssize_t n = write(fd, batch.data() + off, batch.size() - off);
+            if (n < 0 && errno == EINTR)
+                continue;
+            ok = n > 0;
+            off += ok ? n : 0;
+        }
+        if (ok && sync_)
+            ok = fdatasync(fd) == 0;
+        if (!ok && !was_broken)
+            Logger()->Error("write %s failed: %s", path_.c_str(),
+                            strerror(errno));
+        lock.lock();
+        if (ok) {
+            bytes_ += batch.size();
+        } else {
+            broken_ = true;
+            if (!failed_.empty() && failed_.back().second + 1 == first)
+                failed_.back().second = last;
+            else
+                failed_.emplace_back(first, last);
+        }
+        done_ = last;
+        flushing_ = false;
+        cond_.notify_all();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::string path_;
+    int fd_ = -1;
+    bool sync_ = true;
+    bool broken_ = false;   // 写失败过，Rotate 之前不再追加
+    bool flushing_ = false; // 有 leader 正在写
+    std::string pending_;   // 等待 leader 写出的记录
+    uint64_t appended_ = 0; // 已放进 pending_ 的记录序号
+    uint64_t done_ = 0;     // 已写完(成功或失败)的记录序号
+    std::vector<std::pair<uint64_t, uint64_t>> failed_; // 写失败的序号区间
+    uint64_t bytes_ = 0;
+};
+} // namespace storage
@@ -0,0 +1,282 @@
+#pragma once
+#include <pthread.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace storage {
+/**
+ * 分片的元数据内存表，主键是 URL，另外维护按存储路径、修改时间和文件
+ * 大小的二级索引
+ *
+ * 记录放进表后不再修改，以 shared_ptr<const Info> 交给调用者：查询只增加
+ * 引用计数，不复制字符串，拿到的记录在表被更新后仍然有效(是更新前的快照)。
+ * 更新是整条替换。
+ *
+ * 按 URL 的哈希分成 kShards 片，每片一把读写锁，保护本片的 URL 表和
+ * 修改时间、大小两个有序索引，不同 URL 的插入和查询大多落在不同的片上。
+ * 存储路径索引按路径的哈希另外分片。Put 持有 URL 分片的写锁时再依次去锁
+ * 路径分片(同一时刻最多持有一把)，反过来的顺序从不出现，所以不会死锁。
+ * 表中的 key 指向记录自身的字符串，不另存副本；有序索引只存记录地址，
+ * 记录由同一分片的 URL 表持有，两者在同一把锁下增删。
+ *
+ * Info 需要有 url_、storage_path_、mtime_、fsize_ 成员。
+ */
+template <typename Info>
+class MetaTable {
+  public:
+    using Ptr = std::shared_ptr<const Info>;
+    static constexpr size_t kShards = 64;
+
+    MetaTable() {
+        for (auto &shard : url_shards_)
+            pthread_rwlock_init(&shard.lock, nullptr);
+        for (auto &shard : path_shards_)
+            pthread_rwlock_init(&shard.lock, nullptr);
+    }
+    ~MetaTable() {
+        for (auto &shard : url_shards_)
+            pthread_rwlock_destroy(&shard.lock);
+        for (auto &shard : path_shards_)
+            pthread_rwlock_destroy(&shard.lock);
+    }
+    MetaTable(const MetaTable &) = delete;
+    MetaTable &operator=(const MetaTable &) = delete;
+
+    // 预计总记录数，批量装载前调用，避免逐步扩容重新散列
+    void Reserve(const size_t count) {
+        for (auto &shard : url_shards_) {
+            WriteLock lock(&shard.lock);
+            shard.by_url.reserve(count / kShards + 1);
+        }
+        for (auto &shard : path_shards_) {
+            WriteLock lock(&shard.lock);
+            shard.by_path.reserve(count / kShards + 1);
+        }
+    }
+
+    // 插入或整条替换同 URL 的记录
+    void Put(Info info) {
+        Insert(std::move(info), true, [](const Info &) {});
+    }
+
+    /**
+     * 同 Put，并在持有 URL 分片写锁时调用 hook(const Info &)
+     * 同一 URL 的多次 Put 按改表的顺序调用 hook，调用者借此让持久化的
+     * 顺序和内存表一致。hook 内不能再访问本表。
+     */
+    template <typename Hook>
+    void Put(Info info, Hook &&hook) {
+        Insert(std::move(info), true, hook);
+    }
+
+    /**
+     * 批量装载，next(Info *) 返回 false 时结束
+     * 逐条插入有序索引时每条都是一次随机的树插入，记录多时远慢于哈希表，
+     * 所以装载期间只填 URL 表和路径索引，最后逐片排序、整体重建有序索引。
+     * 装载期间其它线程照常读写，只是区间查询会漏掉正在装载的记录。
+     */
+    template <typename Next>
+    void Load(Next &&next) {
+        Info info;
+        while (next(&info))
+            Insert(std::move(info), false, [](const Info &) {});
+        for (auto &shard : url_shards_) {
+            WriteLock lock(&shard.lock);
+            Rebuild(shard);
+        }
+    }
+
+    bool FindByUrl(const std::string_view url, Ptr *out) const {
+        const UrlShard &shard = url_shards_[Shard(url)];
+        ReadLock lock(&shard.lock);
+        auto it = shard.by_url.find(url);
+        if (it == shard.by_url.end())
+            return false;
+        *out = it->second;
+        return true;
+    }
+
+    bool FindByPath(const std::string_view path, Ptr *out) const {
+        const PathShard &shard = path_shards_[Shard(path)];
+        ReadLock lock(&shard.lock);
+        auto it = shard.by_path.find(path);
+        if (it == shard.by_path.end())
+            return false;
+        *out = it->second;
+        return true;
+    }
+
+    // 修改时间在 [from, to] 内的记录，按修改时间升序追加到 out
+    void RangeByMtime(const int64_t from, const int64_t to,
+                      std::vector<Ptr> *out) const {
+        Range(&UrlShard::by_mtime, from, to, out);
+    }
+
+    // 大小在 [min, max] 内的记录，按大小升序追加到 out
+    void RangeBySize(const uint64_t min, const uint64_t max,
+                     std::vector<Ptr> *out) const {
+        Range(&UrlShard::by_size, min, max, out);
+    }
+
+    // 全部记录，无序；各分片分别加锁，不是整个表同一时刻的快照
+    void All(std::vector<Ptr> *out) const {
+        out->reserve(out->size() + Size());
+        for (const auto &shard : url_shards_) {
+            ReadLock lock(&shard.lock);
+            for (const auto &e : shard.by_url)
+                out->push_back(e.second);
+        }
+    }
+
+    size_t Size() const {
+        size_t size = 0;
+        for (const auto &shard : url_shards_) {
+            ReadLock lock(&shard.lock);
+            size += shard.by_url.size();
+        }
+        return size;
+    }
+
+  private:
+    template <typename Key>
+    using Ordered = std::set<std::pair<Key, const Info *>>; // 值相同时按记录地址排序
+
+    struct UrlShard {
+        mutable pthread_rwlock_t lock;
+        std::unordered_map<std::string_view, Ptr> by_url; // key 指向 url_
+        Ordered<int64_t> by_mtime;
+        Ordered<uint64_t> by_size;
+    };
+    struct PathShard {
+        mutable pthread_rwlock_t lock;
+        std::unordered_map<std::string_view, Ptr> by_path; // key 指向 storage_path_
+    };
+
+    class ReadLock {
+      public:
+        explicit ReadLock(pthread_rwlock_t *lock) : lock_(lock) {
+            pthread_rwlock_rdlock(lock_);
+        }
+        ~ReadLock() { pthread_rwlock_unlock(lock_); }
+
+      private:
+        pthread_rwlock_t *lock_;
+    };
+    class WriteLock {
+      public:
+        explicit WriteLock(pthread_rwlock_t *lock) : lock_(lock) {
+            pthread_rwlock_wrlock(lock_);
+        }
+        ~WriteLock() { pthread_rwlock_unlock(lock_); }
+
+      private:
+        pthread_rwlock_t *lock_;
+    };
+
+    // ordered 为 false 时不插入有序索引，由 Load 最后重建
+    template <typename Hook>
+    void Insert(Info info, const bool ordered, Hook &&hook) {
+        Ptr record = std::make_shared<const Info>(std::move(info));
+        Ptr old;
+        UrlShard &shard = url_shards_[Shard(record->url_)];
+        WriteLock lock(&shard.lock);
+        // 新 URL 是多数，先插入，已存在时才查第二次
+        auto inserted = shard.by_url.emplace(record->url_, record);
+        if (!inserted.second) {
+            old = std::move(inserted.first->second);
+            // key 指向旧记录的字符串，不能原地换值
+            shard.by_url.erase(inserted.first);
+            shard.by_url.emplace(record->url_, record);
+            shard.by_mtime.erase({old->mtime_, old.get()});
+            shard.by_size.erase({old->fsize_, old.get()});
+        }
+        if (ordered) {
+            shard.by_mtime.emplace(record->mtime_, record.get());
+            shard.by_size.emplace(record->fsize_, record.get());
+        }
+        // 仍持有 URL 分片的锁，同一 URL 的两次 Put 按顺序改路径索引
+        if (old != nullptr)
+            UnlinkPath(old);
+        LinkPath(record);
+        hook(*record);
+    }
+
+    // 调用者持有分片的写锁，从 URL 表重建两个有序索引
+    static void Rebuild(UrlShard &shard) {
+        std::vector<std::pair<int64_t, const Info *>> mtime;
+        std::vector<std::pair<uint64_t, const Info *>> size;
+        mtime.reserve(shard.by_url.size());
+        size.reserve(shard.by_url.size());
+        for (const auto &e : shard.by_url) {
+            const Info *info = e.second.get();
+            mtime.emplace_back(info->mtime_, info);
+            size.emplace_back(info->fsize_, info);
+        }
+        Build(&mtime).swap(shard.by_mtime);
+        Build(&size).swap(shard.by_size);
+    }
+
+    // 按索引的顺序逐个追加到末尾，每次插入是常数时间
+    template <typename Key>
+    static Ordered<Key> Build(std::vector<std::pair<Key, const Info *>> *sorted) {
+        std::sort(sorted->begin(), sorted->end());
+        return Ordered<Key>(sorted->begin(), sorted->end());
+    }
+
+    static size_t Shard(const std::string_view key) {
+        return std::hash<std::string_view>()(key) % kShards;
+    }
+
+    // 路径索引只在仍指向 old 时删除，两个 URL 共用一个路径时保留后写入的
+    void UnlinkPath(const Ptr &old) {
+        PathShard &shard = path_shards_[Shard(old->storage_path_)];
+        WriteLock lock(&shard.lock);
+        auto it = shard.by_path.find(old->storage_path_);
+        if (it != shard.by_path.end() && it->second == old)
+            shard.by_path.erase(it);
+    }
+    void LinkPath(const Ptr &record) {
+        PathShard &shard = path_shards_[Shard(record->storage_path_)];
+        WriteLock lock(&shard.lock);
+        auto inserted = shard.by_path.emplace(record->storage_path_, record);
+        if (!inserted.second) {
+            shard.by_path.erase(inserted.first);
+            shard.by_path.emplace(record->storage_path_, record);
+        }
+    }
+
+    // 逐片取出区间内的记录，再按索引的值合并排序
+    template <typename Key>
+    void Range(Ordered<Key> UrlShard::*index, const Key from, const Key to,
+               std::vector<Ptr> *out) const {
+        std::vector<std::pair<Key, Ptr>> found;
+        for (const auto &shard : url_shards_) {
+            ReadLock lock(&shard.lock);
+            const Ordered<Key> &ordered = shard.*index;
+            for (auto it = ordered.lower_bound({from, nullptr});
+                 it != ordered.end() && it->first <= to; ++it)
+                found.emplace_back(it->first,
+                                   shard.by_url.find(it->second->url_)->second);
+        }
+        std::stable_sort(found.begin(), found.end(),
+                         [](const std::pair<Key, Ptr> &a,
+                            const std::pair<Key, Ptr> &b) {
+                             return a.first < b.first;
+                         });
+        out->reserve(out->size() + found.size());
+        for (auto &e : found)
+            out->push_back(std::move(e.second));
+    }
+
+    UrlShard url_shards_[kShards];
+    PathShard path_shards_[kShards];
+};
+} // namespace storage
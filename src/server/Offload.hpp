@@ -0,0 +1,145 @@
+#pragma once
+#include "Util.hpp"
+#include "ThreadPool.hpp"
+
+#include <event2/event.h>
+
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+extern ThreadPool *tp;
+
+namespace storage {
+/**
+ * 把阻塞的磁盘读写和压缩解压交给线程池，完成后回到事件循环线程
+ *
+ * 每个事件循环一个实例，循环线程启动时用 Bind 登记为本线程的实例。
+ * Run(work, done) 在线程池中执行 work，然后把 done(work 的返回值) 放进
+ * 发起线程所属循环的完成队列，用 event_active 唤醒循环，在循环线程中
+ * 执行，所以 done 里可以直接调用 evhttp 和 bufferevent。事件循环线程只做
+ * 网络读写。
+ *
+ * 打开文件、stat、生成列表页这类每个请求一次的短操作用 Run，走高优先级的
+ * server_io 调度类；大文件上传下载中逐块的读写和压缩解压用 Bulk，走限制
+ * 并发的 server_bulk 调度类，总给短操作留出空闲线程，大上传进行时小请求
+ * 不用排在它们后面。
+ *
+ * 跨线程 event_active 要求在创建 event_base 之前调用过
+ * evthread_use_pthreads。不在事件循环线程中(没有 Bind)或者没有线程池时，
+ * work 和 done 直接在调用线程中执行。
+ */
+class Offload {
+  public:
+    explicit Offload(event_base *base)
+        : wake_(event_new(base, -1, 0, &Offload::OnWake, this)) {}
+    ~Offload() {
+        if (wake_ != nullptr)
+            event_free(wake_);
+    }
+    Offload(const Offload &) = delete;
+    Offload &operator=(const Offload &) = delete;
+
+    // 在事件循环线程中调用
+    void Bind() { Current() = this; }
+
+    template <typename Work, typename Done>
+    static void Run(Work work, Done done) {
+        Dispatch(Kind::kIo, std::move(work), std::move(done));
+    }
+    template <typename Work, typename Done>
+    static void Bulk(Work work, Done done) {
+        Dispatch(Kind::kBulk, std::move(work), std::move(done));
+    }
+
+  private:
+    enum class Kind { kIo, kBulk };
+    static const char *ClassName(const Kind kind) {
+        return kind == Kind::kIo ? "server_io" : "server_bulk";
+    }
+
+    static Offload *&Current() {
+        static thread_local Offload *current = nullptr;
+        return current;
+    }
+    // 没有配置这个调度类时 findClass 返回普通任务类
+    static ThreadPool::ClassId Class(const Kind kind) {
+        static const ThreadPool::ClassId io =
+            tp->findClass(ClassName(Kind::kIo));
+        static const ThreadPool::ClassId bulk =
+            tp->findClass(ClassName(Kind::kBulk));
+        return kind == Kind::kIo ? io : bulk;
+    }
+
+    template <typename Work, typename Done>
+    static void Dispatch(const Kind kind, Work work, Done done) {
+        Offload *self = Current();
+        if (self == nullptr || tp == nullptr) {
+            Complete(work, done);
+            return;
+        }
+        // 调度类队列满时任务会被丢弃，所以先放在堆上，提交失败就在本线程执行
+        auto *job = new ThreadPool::Task(
+            [self, work = std::move(work), done = std::move(done)]() mutable {
+                if constexpr (std::is_void_v<std::invoke_result_t<Work &>>) {
+                    work();
+                    self->Post(std::move(done));
+                } else {
+                    self->Post([done = std::move(done),
+                                result = work()]() mutable {
+                        done(std::move(result));
+                    });
+                }
+            });
+        if (!tp->postTo(Class(kind), [job]() {
+                (*job)();
+                delete job;
+            })) {
+            Logger()->Warn("%s queue full, run in event loop",
+                           ClassName(kind));
+            (*job)();
+            delete job;
+        }
+    }
+
+    template <typename Work, typename Done>
+    static void Complete(Work &work, Done &done) {
+        if constexpr (std::is_void_v<std::invoke_result_t<Work &>>) {
+            work();
+            done();
+        } else {
+            done(work());
+        }
+    }
+
+    // 可以在任意线程调用
+    template <typename F>
+    void Post(F &&done) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake = completions_.empty();
+            completions_.emplace_back(std::forward<F>(done));
+        }
+        // 队列原来不空说明已经唤醒过、OnWake 还没取走
+        if (wake)
+            event_active(wake_, 0, 0);
+    }
+
+    static void OnWake(evutil_socket_t, short, void *arg) {
+        auto *self = static_cast<Offload *>(arg);
+        std::vector<ThreadPool::Task> completions;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            completions.swap(self->completions_);
+        }
+        for (auto &done : completions)
+            done();
+    }
+
+    event *wake_;
+    std::mutex mutex_;
+    std::vector<ThreadPool::Task> completions_; // 等待在循环线程中执行的 done
+};
+} // namespace storage
@@ -1,16 +1,29 @@
 #pragma once
 #include "DataManager.hpp"
+#include "DownloadStream.hpp"
+#include "Offload.hpp"
+#include "UploadSpool.hpp"
 
 #include <event.h>
 #include <sys/queue.h>
 
 #include <event2/http.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
 #include <evhttp.h>
 
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <random>
 #include <regex>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "base64.h" // 来自 cpp-base64 库
 
@@ -20,55 +33,142 @@ class Service {
   public:
     Service() {
 #ifdef DEBUG_LOG
-        mylog::GetLogger("cloud_storage")->Debug("Service start(Construct)");
+        Logger()->Debug("Service start(Construct)");
 #endif
         server_port_ = Config::GetInstance()->GetServerPort();
         server_ip_ = Config::GetInstance()->GetServerIp();
         download_prefix_ = Config::GetInstance()->GetDownloadPrefix();
 #ifdef DEBUG_LOG
-        mylog::GetLogger("cloud_storage")->Debug("Service end(Construct)");
+        Logger()->Debug("Service end(Construct)");
 #endif
     }
     bool RunModule() {
-        // 初始化环境
-        event_base *base = event_base_new();
-        if (base == nullptr) {
-            mylog::GetLogger("cloud_storage")->Fatal("event_base_new err!");
+        // 回复直接用 writev/sendfile 写 socket，对端关闭时要拿到 EPIPE
+        // 而不是被 SIGPIPE 结束进程
+        signal(SIGPIPE, SIG_IGN);
+        // 线程池完成任务后要跨线程唤醒事件循环，event_base 需要带锁
+        if (evthread_use_pthreads() != 0) {
+            Logger()->Fatal("evthread_use_pthreads failed!");
             return false;
         }
-        // 设置监听的端口和地址
-        sockaddr_in sin;
-        memset(&sin, 0, sizeof(sin));
-        sin.sin_family = AF_INET;
-        sin.sin_port = htons(server_port_);
-
-        // http 服务器,创建evhttp上下文
-        evhttp *httpd = evhttp_new(base);
-        // 绑定端口和ip
-        if (evhttp_bind_socket(httpd, "0.0.0.0", server_port_) != 0) {
-            mylog::GetLogger("cloud_storage")
-                ->Fatal("evhttp_bind_socket failed!");
-            return false;
+        int count = Config::GetInstance()->GetEventLoopThreads();
+        if (count <= 0)
+            count = std::max(1u, std::thread::hardware_concurrency());
+        // 先在当前线程建好所有事件循环并绑定端口，任何一个失败都直接返回
+        std::vector<std::unique_ptr<EventLoop>> loops;
+        for (int i = 0; i < count; ++i) {
+            std::unique_ptr<EventLoop> loop(new EventLoop);
+            if (!loop->Init(server_port_))
+                return false;
+            loops.push_back(std::move(loop));
+        }
+        Logger()->Info("%d event loop(s) listening on port %d", count,
+                       server_port_);
+
+        // 事件循环线程和日志工作线程分开绑核，避免互相抢占。
+        // CPU 足够时每个循环独占一个，否则共用整个列表
+        const std::vector<int> cpus = mylog::util::Affinity::ParseCpuList(
+            Config::GetInstance()->GetEventLoopCpus());
+        std::vector<std::thread> threads;
+        for (int i = 0; i < count; ++i) {
+            std::vector<int> pin = cpus;
+            if (static_cast<int>(cpus.size()) >= count)
+                pin = {cpus[i]};
+            EventLoop *loop = loops[i].get();
+            threads.emplace_back([loop, pin]() {
+                mylog::util::Affinity::PinCurrent(pin);
+                loop->Dispatch();
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        return true;
+    }
+
+  private:
+    /**
+     * 一个事件循环线程：独立的 event_base 和 evhttp
+     *
+     * 每个循环用 SO_REUSEPORT 单独监听同一端口，由内核把新连接分给各循环，
+     * 连接建立后只在所属循环的线程中处理，循环之间不共享 libevent 对象。
+     * 处理函数共享的只有 DataManager、Config 和日志器，它们自己保证线程安全。
+     * 阻塞的磁盘和压缩操作通过本循环的 Offload 交给线程池。
+     */
+    class EventLoop {
+      public:
+        ~EventLoop() {
+            // evhttp 持有监听器和连接，要先于 event_base 释放
+            if (httpd_)
+                evhttp_free(httpd_);
+            offload_.reset();
+            if (base_)
+                event_base_free(base_);
+        }
+
+        bool Init(const uint16_t port) {
+            base_ = event_base_new();
+            if (base_ == nullptr) {
+                Logger()->Fatal("event_base_new err!");
+                return false;
+            }
+            offload_.reset(new Offload(base_));
+            // http 服务器,创建evhttp上下文
+            httpd_ = evhttp_new(base_);
+            if (httpd_ == nullptr) {
+                Logger()->Fatal("evhttp_new err!");
+                return false;
+            }
+            // 上传请求体边接收边写盘，不在内存中攒完整的请求体
+            evhttp_set_bevcb(httpd_, UploadSpool::NewBufferevent, nullptr);
+            const uint64_t max_upload =
+                Config::GetInstance()->GetMaxUploadBytes();
+            if (max_upload > 0)
+                evhttp_set_max_body_size(httpd_,
+                                         static_cast<ev_ssize_t>(max_upload));
+
+            // 设置监听的端口和地址
+            sockaddr_in sin;
+            memset(&sin, 0, sizeof(sin));
+            sin.sin_family = AF_INET;
+            sin.sin_addr.s_addr = htonl(INADDR_ANY);
+            sin.sin_port = htons(port);
+            evconnlistener *listener = evconnlistener_new_bind(
+                base_, nullptr, nullptr,
+                LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC |
+                    LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT,
+                -1, reinterpret_cast<sockaddr *>(&sin), sizeof(sin));
+            if (listener == nullptr) {
+                Logger()->Fatal("bind port %d failed: %s", port,
+                                strerror(errno));
+                return false;
+            }
+            // 监听器交给 evhttp，随 evhttp_free 一起释放
+            if (evhttp_bind_listener(httpd_, listener) == nullptr) {
+                evconnlistener_free(listener);
+                Logger()->Fatal("evhttp_bind_listener failed!");
+                return false;
+            }
+            // 设定回调函数
+            // 指定generic callback，也可以为特定的URI指定callback
+            evhttp_set_gencb(httpd_, GenHandler, nullptr);
+            return true;
         }
-        // 设定回调函数
-        // 指定generic callback，也可以为特定的URI指定callback
-        evhttp_set_gencb(httpd, GenHandler, nullptr);
 
-        if (base) {
+        void Dispatch() {
+            offload_->Bind();
 #ifdef DEBUG_LOG
-            mylog::GetLogger("cloud_storage")->Debug("event_base_dispatch");
+            Logger()->Debug("event_base_dispatch");
 #endif
-            if (-1 == event_base_dispatch(base)) {
-                mylog::GetLogger("cloud_storage")
-                    ->Debug("event_base_dispatch err");
+            if (-1 == event_base_dispatch(base_)) {
+                Logger()->Debug("event_base_dispatch err");
             }
         }
-        if (base)
-            event_base_free(base);
-        if (httpd)
-            evhttp_free(httpd);
-        return true;
-    }
+
+      private:
+        event_base *base_ = nullptr;
+        evhttp *httpd_ = nullptr;
+        std::unique_ptr<Offload> offload_;
+    };
 
   private:
     uint16_t server_port_;
@@ -80,7 +180,7 @@ class Service {
         std::string path =
             evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
         path = UrlDecode(path);
-        mylog::GetLogger("cloud_storage")->Info("get req, uri: %s", path.c_str());
+        Logger()->Info("get req, uri: %s", path.c_str());
 
         // 根据请求中的内容判断是什么请求
         // 这里是下载请求
@@ -100,28 +200,74 @@ class Service {
     }
 
     static void Upload(struct evhttp_request *req, void *arg) {
-        mylog::GetLogger("cloud_storage")->Info("Upload start");
+        Logger()->Info("Upload start");
+        // 请求体已经由 UploadSpool 写进临时文件，凭 id 从本连接的登记中取出
+        const char *spool_id =
+            evhttp_find_header(req->input_headers, "X-Upload-Spool");
+        UploadSpool::Spooled spooled;
+        if (spool_id != nullptr &&
+            !UploadSpool::Take(spool_id, evhttp_request_get_connection(req),
+                               &spooled)) {
+            // 没有被拆分的请求(chunked 之后原样转发)带来的伪造 id
+            Logger()->Warn("upload spool %s not found", spool_id);
+            evhttp_send_reply(req, HTTP_BADREQUEST, "unknown upload", nullptr);
+            return;
+        }
+        if (spooled.error != 0) {
+            const int code = spooled.error;
+            Logger()->Info("upload rejected: %d", code);
+            if (code == 413) {
+                // 剩余的请求体已被丢弃，连接不能再复用
+                evhttp_add_header(req->output_headers, "Connection", "close");
+                evhttp_send_reply(req, 413, "Payload Too Large", nullptr);
+            } else if (code == 400) {
+                evhttp_send_reply(req, HTTP_BADREQUEST,
+                                  "Illegal storage type or file name", nullptr);
+            } else {
+                evhttp_send_reply(req, HTTP_INTERNAL, "server error", nullptr);
+            }
+            return;
+        }
+        if (spooled.session) {
+            UploadSpool::SessionPtr session = std::move(spooled.session);
+            // rename、stat 和元数据持久化都在线程池中完成
+            Offload::Run(
+                [session]() {
+                    if (!session->Commit()) {
+                        Logger()->Error("upload commit failed");
+                        return false;
+                    }
+                    Logger()->Info(
+                        "upload spooled %llu bytes to %s",
+                        static_cast<unsigned long long>(session->Size()),
+                        session->FinalPath().c_str());
+                    AddStorageInfo(session->FinalPath());
+                    return true;
+                },
+                [req](bool ok) { ReplyUpload(req, ok); });
+            return;
+        }
+        // 以下是 chunked 等没有被拆分的上传，请求体在内存中
         // 约定：请求中包含"low_storage"，说明请求中存在文件数据,并希望普通存储\
                 包含"deep_storage"字段则压缩后存储
         // 获取请求体内容
         struct evbuffer *buf = evhttp_request_get_input_buffer(req);
         if (buf == nullptr) {
-            mylog::GetLogger("cloud_storage")
-                ->Info("evhttp_request_get_input_buffer is empty");
+            Logger()->Info("evhttp_request_get_input_buffer is empty");
             return;
         }
 
         size_t len = evbuffer_get_length(buf); // 获取请求体的长度
-        mylog::GetLogger("cloud_storage")->Info("evbuffer_get_length is %u", len);
+        Logger()->Info("evbuffer_get_length is %u", len);
         if (0 == len) {
             evhttp_send_reply(req, HTTP_BADREQUEST, "file empty", nullptr);
-            mylog::GetLogger("cloud_storage")->Info("request body is empty");
+            Logger()->Info("request body is empty");
             return;
         }
         std::string content(len, 0);
         // 将请求体内容复制到content中
         if (-1 == evbuffer_copyout(buf, (void *)content.c_str(), len)) {
-            mylog::GetLogger("cloud_storage")->Error("evbuffer_copyout error");
+            Logger()->Error("evbuffer_copyout error");
             evhttp_send_reply(req, HTTP_INTERNAL, nullptr, nullptr);
             return;
         }
@@ -142,13 +288,26 @@ class Service {
         } else if (storage_type == "deep") {
             storage_path = Config::GetInstance()->GetDeepStorageDir();
         } else {
-            mylog::GetLogger("cloud_storage")
-                ->Info("evhttp_send_reply: HTTP_BADREQUEST");
+            Logger()->Info("evhttp_send_reply: HTTP_BADREQUEST");
             evhttp_send_reply(req, HTTP_BADREQUEST, "Illegal storage type",
                               nullptr);
             return;
         }
+        // 建目录、写文件(deep 还要压缩)和元数据持久化都在线程池中完成
+        Offload::Bulk(
+            [content = std::move(content), storage_path, filename]() mutable {
+                return StoreContent(content, storage_path, filename);
+            },
+            [req](bool ok) { ReplyUpload(req, ok); });
+    }
 
+    /**
+     * 把内存中的请求体写进存储目录 storage_path 下的 filename 并登记，
+     * 在线程池中执行
+     */
+    static bool StoreContent(const std::string &content,
+                             std::string storage_path,
+                             const std::string &filename) {
         // 如果不存在就创建low或deep目录
         FileUtil dirCreate(storage_path);
         dirCreate.CreateDirectory();
@@ -156,41 +315,46 @@ class Service {
         // 目录创建后加可以加上文件名，这个就是最终要写入的文件路径
         storage_path += filename;
 #ifdef DEBUG_LOG
-        mylog::GetLogger("cloud_storage")
-            ->Debug("storage_path:%s", storage_path.c_str());
+        Logger()->Debug("storage_path:%s", storage_path.c_str());
 #endif
 
         // 看路径里是low还是deep存储，是deep就压缩，是low就直接写入
         FileUtil fu(storage_path);
         if (storage_path.find("low_storage") != std::string::npos) {
-            if (fu.SetContent(content.c_str(), len) == false) {
-                mylog::GetLogger("cloud_storage")
-                    ->Error(
-                        "low_storage fail, evhttp_send_reply: HTTP_INTERNAL");
-                evhttp_send_reply(req, HTTP_INTERNAL, "server error", nullptr);
-                return;
-            } else {
-                mylog::GetLogger("cloud_storage")->Info("low_storage success");
+            if (fu.SetContent(content.c_str(), content.size()) == false) {
+                Logger()->Error("low_storage fail");
+                return false;
             }
+            Logger()->Info("low_storage success");
         } else {
-            if (fu.Compress(content) == false) {
-                mylog::GetLogger("cloud_storage")
-                    ->Error(
-                        "deep_storage fail, evhttp_send_reply: HTTP_INTERNAL");
-                evhttp_send_reply(req, HTTP_INTERNAL, "server error", nullptr);
-                return;
-            } else {
-                mylog::GetLogger("cloud_storage")->Info("deep_storage success");
+            if (fu.Compress(content, Config::GetInstance()->GetZstdLevel(),
+                            Config::GetInstance()->GetZstdWorkers(),
+                            Config::GetInstance()->GetZstdFrameSize()) ==
+                false) {
+                Logger()->Error("deep_storage fail");
+                return false;
             }
+            Logger()->Info("deep_storage success");
         }
+        AddStorageInfo(storage_path);
+        return true;
+    }
 
-        // 添加存储文件信息，交由数据管理类进行管理
+    // 添加存储文件信息，交由数据管理类进行管理
+    static void AddStorageInfo(const std::string &storage_path) {
         StorageInfo info;
         info.NewStorageInfo(storage_path); // 组织存储的文件信息
         data_->Insert(info);               // 向数据管理模块添加存储的文件信息
+    }
 
+    static void ReplyUpload(evhttp_request *req, const bool ok) {
+        if (!ok) {
+            Logger()->Error("upload fail, evhttp_send_reply: HTTP_INTERNAL");
+            evhttp_send_reply(req, HTTP_INTERNAL, "server error", nullptr);
+            return;
+        }
         evhttp_send_reply(req, HTTP_OK, "Success", nullptr);
-        mylog::GetLogger("cloud_storage")->Info("upload finish:success");
+        Logger()->Info("upload finish:success");
     }
 
     static std::string TimetoStr(time_t t) {
@@ -201,11 +365,12 @@ class Service {
     // 前端代码处理函数
     // 在渲染函数中直接处理 StorageInfo
     static std::string
-    generateModernFileList(const std::vector<StorageInfo> &files) {
+    generateModernFileList(const std::vector<StorageInfoPtr> &files) {
         std::stringstream ss;
         ss << "<div class='file-list'><h3>已上传文件</h3>";
 
-        for (const auto &file : files) {
+        for (const auto &ptr : files) {
+            const StorageInfo &file = *ptr;
             std::string filename = FileUtil(file.storage_path_).FileName();
 
             // 从路径中解析存储类型（示例逻辑，需根据实际路径规则调整）
@@ -249,10 +414,27 @@ class Service {
         return ss.str();
     }
     static void ListShow(struct evhttp_request *req, void *arg) {
-        mylog::GetLogger("cloud_storage")->Info("ListShow()");
-        // 1. 获取所有的文件存储信息
-        std::vector<StorageInfo> arry;
-        data_->GetAll(&arry);
+        Logger()->Info("ListShow()");
+        // 读模板文件和渲染页面在线程池中完成
+        Offload::Run(RenderList, [req](std::string response_body) {
+            // 获取请求的输出evbuffer
+            struct evbuffer *buf = evhttp_request_get_output_buffer(req);
+            // 把前面的html数据给到evbuffer，然后设置响应头部字段，最后返回给浏览器
+            evbuffer_add(buf, (const void *)response_body.c_str(),
+                         response_body.size());
+            evhttp_add_header(req->output_headers, "Content-Type",
+                              "text/html;charset=utf-8");
+            evhttp_send_reply(req, HTTP_OK, nullptr, nullptr);
+            Logger()->Info("ListShow() finish");
+        });
+    }
+
+    static std::string RenderList() {
+        // 1. 获取所有的文件存储信息，按修改时间索引取出，最新的排在前面
+        std::vector<StorageInfoPtr> arry;
+        data_->GetByMtime(std::numeric_limits<time_t>::min(),
+                          std::numeric_limits<time_t>::max(), &arry);
+        std::reverse(arry.begin(), arry.end());
 
         // 读取模板文件
         std::ifstream templateFile("index.html");
@@ -271,16 +453,7 @@ class Service {
             "http://" + storage::Config::GetInstance()->GetServerIp() + ":" +
                 std::to_string(
                     storage::Config::GetInstance()->GetServerPort()));
-        // 获取请求的输出evbuffer
-        struct evbuffer *buf = evhttp_request_get_output_buffer(req);
-        auto response_body = templateContent;
-        // 把前面的html数据给到evbuffer，然后设置响应头部字段，最后返回给浏览器
-        evbuffer_add(buf, (const void *)response_body.c_str(),
-                     response_body.size());
-        evhttp_add_header(req->output_headers, "Content-Type",
-                          "text/html;charset=utf-8");
-        evhttp_send_reply(req, HTTP_OK, nullptr, nullptr);
-        mylog::GetLogger("cloud_storage")->Info("ListShow() finish");
+        return templateContent;
     }
     static std::string GetETag(const StorageInfo &info) {
         // 自定义etag :  filename-fsize-mtime
@@ -292,107 +465,229 @@ class Service {
         etag += std::to_string(info.mtime_);
         return etag;
     }
+    enum class RangeResult {
+        kNone,          // 没有可用的 Range，发送整个文件
+        kOk,            // ranges 中是要发送的区间
+        kUnsatisfiable, // 所有区间都超出文件范围，回复 416
+    };
+    static constexpr size_t kMaxRanges = 16;
+
+    /**
+     * 解析 Range: bytes=a-b,c-,-n
+     * 语法错误或者区间过多时按没有 Range 处理；超出文件范围的区间被忽略，
+     * 结尾超出的截到文件末尾
+     * @param ranges 输出闭区间 [first, second]
+     */
+    static RangeResult
+    ParseRange(const std::string &header, const uint64_t size,
+               std::vector<std::pair<uint64_t, uint64_t>> *ranges) {
+        static const std::regex spec_re(R"(\s*(\d*)\s*-\s*(\d*)\s*)");
+        if (strncasecmp(header.c_str(), "bytes=", 6) != 0)
+            return RangeResult::kNone;
+        std::stringstream ss(header.substr(6));
+        std::string spec;
+        size_t count = 0;
+        while (std::getline(ss, spec, ',')) {
+            if (spec.find_first_not_of(" \t") == std::string::npos)
+                continue;
+            std::smatch m;
+            if (++count > kMaxRanges || !std::regex_match(spec, m, spec_re) ||
+                (m[1].length() == 0 && m[2].length() == 0))
+                return RangeResult::kNone;
+            uint64_t first, last = size - 1;
+            try {
+                if (m[1].length() == 0) {
+                    // 后缀区间：最后 n 个字节
+                    const uint64_t n = std::stoull(m[2]);
+                    if (n == 0 || size == 0)
+                        continue;
+                    first = size - std::min(n, size);
+                } else {
+                    first = std::stoull(m[1]);
+                    if (m[2].length() > 0) {
+                        const uint64_t end = std::stoull(m[2]);
+                        if (end < first)
+                            return RangeResult::kNone;
+                        last = std::min(end, last);
+                    }
+                    if (first >= size)
+                        continue;
+                }
+            } catch (const std::exception &) {
+                return RangeResult::kNone; // 数字超出范围
+            }
+            ranges->emplace_back(first, last);
+        }
+        if (count == 0)
+            return RangeResult::kNone;
+        return ranges->empty() ? RangeResult::kUnsatisfiable
+                               : RangeResult::kOk;
+    }
+
+    static std::string ContentRange(const uint64_t first, const uint64_t last,
+                                    const uint64_t size) {
+        return "bytes " + std::to_string(first) + "-" + std::to_string(last) +
+               "/" + std::to_string(size);
+    }
+
+    // multipart/byteranges 的分隔串，随机生成以免与文件内容冲突
+    static std::string NewBoundary() {
+        static thread_local std::mt19937_64 rng(std::random_device{}());
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%016llx",
+                 static_cast<unsigned long long>(rng()));
+        return std::string("byteranges_") + buf;
+    }
+
     static void Download(struct evhttp_request *req, void *arg) {
         // 1. 获取客户端请求的资源路径path   req.path
         // 2. 根据资源路径，获取StorageInfo
-        StorageInfo info;
+        StorageInfoPtr info;
         std::string resource_path =
             evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
         resource_path = UrlDecode(resource_path);
-        data_->GetOneByURL(resource_path, &info);
-        mylog::GetLogger("cloud_storage")
-            ->Info("request resource_path:%s", resource_path.c_str());
-
-        std::string download_path = info.storage_path_;
-        // 2.如果压缩过了就解压到新文件给用户下载
-        if (info.storage_path_.find(
-                Config::GetInstance()->GetLowStorageDir()) ==
-            std::string::npos) // 如果文件不是在low_storage目录下，则解压
-        {
-            mylog::GetLogger("cloud_storage")
-                ->Info("uncompressing:%s", info.storage_path_.c_str());
-            FileUtil fu(info.storage_path_);
-            download_path = Config::GetInstance()->GetLowStorageDir() +
-                            std::string(download_path.begin() +
-                                            download_path.find_last_of('/') + 1,
-                                        download_path.end());
-            FileUtil dirCreate(Config::GetInstance()->GetLowStorageDir());
-            dirCreate.CreateDirectory();
-            fu.UnCompress(
-                download_path); // 将文件解压到low_storage下去或者再创一个文件夹做中转
-        }
-        mylog::GetLogger("cloud_storage")
-            ->Info("request download_path:%s", download_path.c_str());
-        FileUtil fu(download_path);
-        if (fu.Exists() == false &&
-            info.storage_path_.find("deep_storage") != std::string::npos) {
-            // 如果是压缩文件，且解压失败，是服务端的错误
-            mylog::GetLogger("cloud_storage")
-                ->Info("evhttp_send_reply: 500 - UnCompress failed");
-            evhttp_send_reply(req, HTTP_INTERNAL, nullptr, nullptr);
-        } else if (fu.Exists() == false &&
-                   info.storage_path_.find("low_storage") ==
-                       std::string::npos) {
-            // 如果是普通文件，且文件不存在，是客户端的错误
-            mylog::GetLogger("cloud_storage")
-                ->Info("evhttp_send_reply: 400 - bad request,file not exists");
-            evhttp_send_reply(req, HTTP_BADREQUEST, "file not exists", nullptr);
+        Logger()->Info("request resource_path:%s", resource_path.c_str());
+        if (!data_->GetOneByURL(resource_path, &info)) {
+            evhttp_send_reply(req, 404, (resource_path + "not exists").c_str(),
+                              nullptr);
+            return;
         }
 
-        // 3.确认文件是否需要断点续传
-        bool retrans = false;
-        std::string old_etag;
-        auto if_range = evhttp_find_header(req->input_headers, "If-Range");
-        if (nullptr != if_range) {
-            old_etag = if_range;
-            // 有If-Range字段且，这个字段的值与请求文件的最新etag一致则符合断点续传
-            if (old_etag == GetETag(info)) {
-                retrans = true;
-                mylog::GetLogger("cloud_storage")
-                    ->Info("%s need breakpoint continuous transmission",
-                           download_path.c_str());
-            }
-        }
+        std::string download_path = info->storage_path_;
+        // 如果文件不是在low_storage目录下，则是压缩过的，发送时边读边解压
+        const bool packed =
+            info->storage_path_.find(
+                Config::GetInstance()->GetLowStorageDir()) ==
+            std::string::npos;
+        Logger()->Info("request download_path:%s", download_path.c_str());
+
+        // 3. 查文件状态要读磁盘，在线程池中完成：普通文件直接打开，
+        // 压缩文件打开后判断格式、读出解压后的大小，打开的流留给发送使用
+        Offload::Run(
+            [download_path, packed]() {
+                DownloadTarget target;
+                if (packed) {
+                    target.stream = DownloadStream::Prepare(
+                        download_path, &target.size, &target.size_known);
+                    target.exists = target.stream != nullptr ||
+                                    FileUtil(download_path).Exists();
+                    if (target.exists && !target.size_known)
+                        target.size = FileUtil(download_path).FileSize();
+                    return target;
+                }
+                target.fd = open(download_path.c_str(), O_RDONLY);
+                struct stat st;
+                target.exists = target.fd >= 0 && fstat(target.fd, &st) == 0;
+                target.size = target.exists ? st.st_size : 0;
+                target.size_known = target.exists;
+                return target;
+            },
+            [req, info, packed](DownloadTarget target) {
+                Respond(req, *info, packed, std::move(target));
+            });
+    }
 
-        // 4. 读取文件数据，放入 rsp.body 中
-        if (fu.Exists() == false) {
-            mylog::GetLogger("cloud_storage")
-                ->Info("%s not exists", download_path.c_str());
-            download_path += "not exists";
-            evhttp_send_reply(req, 404, download_path.c_str(), nullptr);
+    // 下载文件在线程池中查到的状态
+    struct DownloadTarget {
+        bool exists = false;
+        bool size_known = false; // 压缩文件的帧头或跳转表没有记录原始大小时为 false
+        uint64_t size = 0;       // 普通文件的大小或压缩文件解压后的大小
+        int fd = -1;             // 已打开的普通文件
+        std::unique_ptr<DownloadStream> stream; // 已打开并判断了格式的压缩文件
+    };
+
+    static void Respond(evhttp_request *req, const StorageInfo &info,
+                        const bool packed, DownloadTarget target) {
+        const std::string &download_path = info.storage_path_;
+        // 文件不存在时回复 404
+        if (!target.exists) {
+            Logger()->Info("%s not exists", download_path.c_str());
+            if (target.fd >= 0)
+                close(target.fd);
+            evhttp_send_reply(req, 404, (download_path + "not exists").c_str(),
+                              nullptr);
             return;
         }
-        evbuffer *outbuf = evhttp_request_get_output_buffer(req);
-        int fd = open(download_path.c_str(), O_RDONLY);
-        if (fd == -1) {
-            mylog::GetLogger("cloud_storage")
-                ->Error("open file error: %s -- %s", download_path.c_str(),
-                        strerror(errno));
-            evhttp_send_reply(req, HTTP_INTERNAL, strerror(errno), nullptr);
+        // 压缩文件的区间按解压后的内容计算，大小未知时不支持区间请求
+        const uint64_t size = target.size;
+        const bool size_known = target.size_known;
+
+        // 4.确认文件是否需要断点续传：有 Range 字段，且没有 If-Range 或者
+        // If-Range 与请求文件最新的 etag 一致时只发送请求的区间
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        RangeResult range_result = RangeResult::kNone;
+        const char *range = evhttp_find_header(req->input_headers, "Range");
+        const char *if_range =
+            evhttp_find_header(req->input_headers, "If-Range");
+        if (range != nullptr && size_known &&
+            (if_range == nullptr || GetETag(info) == if_range))
+            range_result = ParseRange(range, size, &ranges);
+        if (range_result == RangeResult::kUnsatisfiable) {
+            Logger()->Info("evhttp_send_reply: 416 - %s", range);
+            if (target.fd >= 0)
+                close(target.fd);
+            evhttp_add_header(req->output_headers, "Content-Range",
+                              ("bytes */" + std::to_string(size)).c_str());
+            evhttp_send_reply(req, 416, "Range Not Satisfiable", nullptr);
             return;
         }
-        // 和前面用的evbuffer_add类似，但是效率更高，具体原因可以看函数声明
-        if (-1 == evbuffer_add_file(outbuf, fd, 0, fu.FileSize())) {
-            mylog::GetLogger("cloud_storage")
-                ->Error("evbuffer_add_file: %d -- %s -- %s", fd,
-                        download_path.c_str(), strerror(errno));
-        }
+
         // 5. 设置响应头部字段： ETag， Accept-Ranges: bytes
-        evhttp_add_header(req->output_headers, "Accept-Ranges", "bytes");
+        evhttp_add_header(req->output_headers, "Accept-Ranges",
+                          size_known ? "bytes" : "none");
         evhttp_add_header(req->output_headers, "ETag", GetETag(info).c_str());
-        evhttp_add_header(req->output_headers, "Content-Type",
-                          "application/octet-stream");
-        if (retrans == false) {
-            evhttp_send_reply(req, HTTP_OK, "Success", nullptr);
-            mylog::GetLogger("cloud_storage")->Info("evhttp_send_reply: HTTP_OK");
+        std::vector<DownloadStream::Part> parts;
+        std::string tail;
+        int code = HTTP_OK;
+        const char *reason = "Success";
+        if (range_result == RangeResult::kNone) {
+            evhttp_add_header(req->output_headers, "Content-Type",
+                              "application/octet-stream");
+            parts.push_back({"", 0, DownloadStream::kAll});
         } else {
-            evhttp_send_reply(req, 206, "breakpoint continuous transmission",
-                              nullptr); // 区间请求响应的是206
-            mylog::GetLogger("cloud_storage")->Info("evhttp_send_reply: 206");
+            code = 206; // 区间请求响应的是206
+            reason = "Partial Content";
+            Logger()->Info("%s need breakpoint continuous transmission: %s",
+                           download_path.c_str(), range);
+            if (ranges.size() == 1) {
+                evhttp_add_header(req->output_headers, "Content-Type",
+                                  "application/octet-stream");
+                evhttp_add_header(
+                    req->output_headers, "Content-Range",
+                    ContentRange(ranges[0].first, ranges[0].second, size)
+                        .c_str());
+                parts.push_back({"", ranges[0].first,
+                                 ranges[0].second - ranges[0].first + 1});
+            } else {
+                // 多个区间用 multipart/byteranges，每段前面是分隔行和段头
+                const std::string boundary = NewBoundary();
+                evhttp_add_header(
+                    req->output_headers, "Content-Type",
+                    ("multipart/byteranges; boundary=" + boundary).c_str());
+                for (const auto &r : ranges) {
+                    std::string head = parts.empty() ? "" : "\r\n";
+                    head += "--" + boundary +
+                            "\r\nContent-Type: application/octet-stream\r\n"
+                            "Content-Range: " +
+                            ContentRange(r.first, r.second, size) +
+                            "\r\n\r\n";
+                    parts.push_back(
+                        {std::move(head), r.first, r.second - r.first + 1});
+                }
+                tail = "\r\n--" + boundary + "--\r\n";
+            }
         }
-        if (download_path != info.storage_path_) {
-            remove(download_path.c_str()); // 删除文件
+
+        // 6. 普通文件用 sendfile 发送，压缩文件边读边解压
+        if (packed) {
+            Logger()->Info("uncompressing:%s", download_path.c_str());
+            DownloadStream::Send(req, std::move(target.stream), code, reason,
+                                 parts, tail);
+        } else {
+            DownloadStream::SendFile(req, target.fd, size, code, reason,
+                                     parts, tail);
         }
+        Logger()->Info("evhttp_send_reply: %d", code);
     }
 };
 } // namespace storage
@@ -1,9 +1,13 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <functional>
+#include <algorithm>
 #include <thread>
 #include <fstream>
 #include <memory>
+#include <atomic>
+#include <cstdint>
 using std::cout;
 using std::endl;
 #include "../../log_system/log_src/MyLog.hpp"
@@ -33,6 +37,11 @@ class Timer {
 
 void init_thread_pool() {
     tp = new ThreadPool(mylog::util::LogConfig::GetJsonData()->thread_count);
+    for (const auto &tc : mylog::util::LogConfig::GetJsonData()->thread_classes) {
+        tp->addClass(tc.name, tc.priority, tc.max_concurrency, tc.max_queue);
+    }
+    tp->setCpuAffinity(mylog::util::Affinity::ParseCpuList(
+        mylog::util::LogConfig::GetJsonData()->pool_cpus));
 }
 
 // 简单的同步日志器类
@@ -130,7 +139,7 @@ void test_throughput_comparison(int log_count) {
          << (async_timer.getDurationMs() / log_count) << " ms/条" << endl;
     
     // 等待异步日志处理完成
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    mylog::GetLogger("cloud_storage")->Flush(std::chrono::seconds(10));
     
     // 同步日志测试
     cout << "\n--- 同步日志系统 ---" << endl;
@@ -203,7 +212,7 @@ void test_concurrent_throughput_comparison(int thread_count, int logs_per_thread
     cout << "总吞吐量: " << std::fixed << std::setprecision(0) << async_throughput << " 条/秒" << endl;
     
     // 等待异步日志处理完成
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    mylog::GetLogger("cloud_storage")->Flush(std::chrono::seconds(10));
     
     // 同步日志多线程测试
     cout << "\n--- 同步日志系统 (多线程) ---" << endl;
@@ -241,6 +250,53 @@ void test_concurrent_throughput_comparison(int thread_count, int logs_per_thread
     cout << "速度提升: " << std::fixed << std::setprecision(2) << speedup << "x" << endl;
 }
 
+// 测试线程池单个任务的提交和执行开销：future / post / 批量提交
+void test_threadpool_submit_cost(int task_count) {
+    cout << "\n===== 线程池任务提交开销测试 =====" << endl;
+    cout << "任务数: " << task_count << endl;
+
+    std::atomic<int> done{0};
+    auto run = [&](const char *title, auto submit_all) {
+        done = 0;
+        Timer submit_timer, total_timer;
+        total_timer.start();
+        submit_timer.start();
+        submit_all();
+        submit_timer.stop();
+        while (done.load() < task_count) {
+            std::this_thread::yield();
+        }
+        total_timer.stop();
+        cout << title << " 提交: " << std::fixed << std::setprecision(1)
+             << submit_timer.getDurationMs() * 1e6 / task_count
+             << " ns/任务, 提交+执行: "
+             << total_timer.getDurationMs() * 1e6 / task_count << " ns/任务"
+             << endl;
+    };
+
+    run("addTask(future)", [&]() {
+        for (int i = 0; i < task_count; i++) {
+            tp->addTask([&]() { done++; });
+        }
+    });
+    run("post           ", [&]() {
+        for (int i = 0; i < task_count; i++) {
+            tp->post([&]() { done++; });
+        }
+    });
+    run("addTasks(批量) ", [&]() {
+        const int batch = 256;
+        std::vector<std::function<void()>> tasks;
+        for (int i = 0; i < task_count; i += batch) {
+            tasks.clear();
+            for (int j = i; j < std::min(task_count, i + batch); j++) {
+                tasks.emplace_back([&]() { done++; });
+            }
+            tp->addTasks(tasks);
+        }
+    });
+}
+
 int main() {
     cout << "========== 异步 vs 同步日志系统吞吐量测试 ==========" << endl;
     cout << "初始化线程池..." << endl;
@@ -260,10 +316,14 @@ int main() {
     
     // 2. 多线程并发吞吐量比较测试
     test_concurrent_throughput_comparison(4, 2500);  // 4线程，每线程2500条
+
+    // 3. 线程池任务提交开销测试
+    test_threadpool_submit_cost(1000000);
     
     // 等待所有异步日志写入完成
     cout << "\n等待异步日志写入完成..." << endl;
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (!mylog::LoggerManager::GetInstance().FlushAll(std::chrono::seconds(10)))
+        cout << "刷盘屏障超时" << endl;
     
     cout << "\n测试完成！" << endl;
     cout << "异步日志文件: ../log_system/logfile/async_throughput_test.log" << endl;
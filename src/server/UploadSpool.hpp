@@ -0,0 +1,667 @@
+#pragma once
+#include "Offload.hpp"
+#include "Util.hpp"
+#include "base64.h"
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+namespace storage {
+/**
+ * 一次上传的落盘文件
+ *
+ * 请求体写到目标目录下的临时文件 <目标>.upload-XXXXXX，Commit 时再原子地
+ * rename 成目标文件；没有 Commit 的临时文件在析构时删除。
+ * 深度存储的请求体边接收边用 zstd 流式压缩，临时文件里就是压缩结果。
+ */
+class UploadSession {
+  public:
+    UploadSession(std::string final_path, std::string storage_type)
+        : final_path_(std::move(final_path)),
+          storage_type_(std::move(storage_type)) {}
+    ~UploadSession() {
+        if (fd_ >= 0)
+            close(fd_);
+        if (!temp_path_.empty() && !committed_)
+            unlink(temp_path_.c_str());
+    }
+    UploadSession(const UploadSession &) = delete;
+    UploadSession &operator=(const UploadSession &) = delete;
+
+    /**
+     * 根据请求头中的文件名(base64)和存储类型得到最终存储路径，并创建目录
+     * @return 存储类型或文件名非法时返回 false
+     */
+    static bool ResolvePath(const std::string &filename_b64,
+                            const std::string &storage_type,
+                            std::string *path) {
+        std::string dir;
+        if (storage_type == "low") {
+            dir = Config::GetInstance()->GetLowStorageDir();
+        } else if (storage_type == "deep") {
+            dir = Config::GetInstance()->GetDeepStorageDir();
+        } else {
+            return false;
+        }
+        const std::string filename = base64_decode(filename_b64);
+        if (filename.empty() || filename.find('/') != std::string::npos)
+            return false;
+        FileUtil(dir).CreateDirectory();
+        *path = dir + filename;
+        return true;
+    }
+
+    // size 为请求体长度，深度存储时写进 zstd 帧头
+    bool Open(uint64_t size) {
+        temp_path_ = final_path_ + ".upload-XXXXXX";
+        fd_ = mkstemp(&temp_path_[0]);
+        if (fd_ < 0) {
+            Logger()->Error("mkstemp %s failed: %s", temp_path_.c_str(),
+                            strerror(errno));
+            temp_path_.clear();
+            return false;
+        }
+        // mkstemp 建的文件只有属主可读写，与直接写出的存储文件保持一致
+        fchmod(fd_, 0644);
+        if (storage_type_ == "deep")
+            packer_.reset(new zstd_wrapper::StreamPacker(
+                Config::GetInstance()->GetZstdLevel(),
+                Config::GetInstance()->GetZstdWorkers(), size,
+                Config::GetInstance()->GetZstdFrameSize()));
+        return true;
+    }
+
+    /**
+     * 把 buf 开头的 len 字节写入临时文件并从 buf 中移除
+     * 写失败后丢弃剩余数据，Commit 会返回失败
+     */
+    void Write(evbuffer *buf, size_t len) {
+        size_ += len;
+        if (packer_) {
+            // 逐段压缩 evbuffer 中的数据，不拷贝成连续内存
+            evbuffer_ptr pos;
+            evbuffer_ptr_set(buf, &pos, 0, EVBUFFER_PTR_SET);
+            size_t left = len;
+            evbuffer_iovec vec;
+            while (left > 0 && !failed_ &&
+                   evbuffer_peek(buf, left, &pos, &vec, 1) > 0) {
+                const size_t n = std::min(left, vec.iov_len);
+                if (!packer_->Update(vec.iov_base, n, Sink()))
+                    Fail("compress");
+                left -= n;
+                evbuffer_ptr_set(buf, &pos, n, EVBUFFER_PTR_ADD);
+            }
+            evbuffer_drain(buf, len);
+            return;
+        }
+        while (len > 0 && !failed_) {
+            const int n = evbuffer_write_atmost(buf, fd_, len);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                Fail("write");
+                break;
+            }
+            len -= n;
+        }
+        evbuffer_drain(buf, len);
+    }
+
+    // 请求体接收完毕，写出压缩帧的剩余部分并关闭临时文件
+    bool Finish() {
+        if (packer_ && !failed_ && !packer_->End(Sink()))
+            Fail("compress");
+        packer_.reset();
+        if (fd_ >= 0 && close(fd_) != 0)
+            failed_ = true;
+        fd_ = -1;
+        return !failed_;
+    }
+
+    // 把临时文件原子地替换为目标文件
+    bool Commit() {
+        if (failed_ || temp_path_.empty())
+            return false;
+        if (rename(temp_path_.c_str(), final_path_.c_str()) != 0) {
+            Logger()->Error("rename %s -> %s failed: %s", temp_path_.c_str(),
+                            final_path_.c_str(), strerror(errno));
+            return false;
+        }
+        committed_ = true;
+        return true;
+    }
+
+    const std::string &FinalPath() const { return final_path_; }
+    uint64_t Size() const { return size_; }
+
+  private:
+    // 压缩结果写入临时文件
+    zstd_wrapper::StreamPacker::Sink Sink() {
+        return [this](const char *data, size_t len) {
+            while (len > 0) {
+                const ssize_t n = write(fd_, data, len);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                len -= n;
+            }
+            return true;
+        };
+    }
+    void Fail(const char *what) {
+        Logger()->Error("%s %s failed: %s", what, temp_path_.c_str(),
+                        strerror(errno));
+        failed_ = true;
+    }
+
+    std::string final_path_;
+    std::string storage_type_;
+    std::string temp_path_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    bool failed_ = false;
+    bool committed_ = false;
+    std::unique_ptr<zstd_wrapper::StreamPacker> packer_;
+};
+
+/**
+ * 上传请求体流式落盘
+ *
+ * libevent 2.1 的 evhttp 会把整个请求体读进内存后才调用处理函数，而且
+ * 服务端请求在读请求头之前没有机会设置分块回调(evhttp_set_newreqcb 是
+ * 2.2 才有的)。因此通过 evhttp_set_bevcb 给每个连接套一层过滤
+ * bufferevent，在 evhttp 之前解析字节流：
+ * 1. 普通请求原样交给 evhttp，按 Content-Length 跳过请求体以找到下一个请求
+ * 2. POST /upload 的请求头先扣下，请求体边到达边写进临时文件，写完后把
+ *    Content-Length 改成 0、加上 X-Upload-Spool: <id> 再交给 evhttp，
+ *    Service::Upload 凭 id 取出落盘结果(已落盘的文件或错误码)
+ * 3. 超过 max_upload_bytes 的上传登记 413 后交给 evhttp，剩余数据全部
+ *    丢弃，由处理函数回复后关闭连接
+ * 客户端自己带的 X-Upload-Spool 在每个请求头里都被删掉；id 是随机数，
+ * 登记时记下所属连接，只有同一个连接上的请求能取走，无法冒用别人的上传。
+ * 写临时文件和压缩在线程池中进行(见 Offload)，事件循环线程只把收到的
+ * 数据移进待写队列；同一个上传同时只有一个写盘任务，保证写入顺序。
+ * 待写数据超过 kMaxQueued 时暂停解析，底层 bufferevent 的读高水位随之
+ * 停止读 socket，写盘任务追上后再继续，每个上传占用的内存与文件大小无关。
+ * 分块传输编码(chunked)的请求不拆分，交给 evhttp 按原来的方式处理。
+ */
+class UploadSpool {
+  public:
+    using SessionPtr = std::shared_ptr<UploadSession>;
+
+    // evhttp_set_bevcb 的回调：为新连接创建带过滤层的 bufferevent
+    static bufferevent *NewBufferevent(event_base *base, void * /*arg*/) {
+        bufferevent *underlying =
+            bufferevent_socket_new(base, -1, BEV_OPT_CLOSE_ON_FREE);
+        if (underlying == nullptr)
+            return nullptr;
+        auto *conn = new Connection;
+        bufferevent *bev = bufferevent_filter_new(
+            underlying, &UploadSpool::Input, &UploadSpool::Output,
+            BEV_OPT_CLOSE_ON_FREE, &UploadSpool::FreeConnection, conn);
+        if (bev == nullptr) {
+            delete conn;
+            bufferevent_free(underlying);
+            return nullptr;
+        }
+        conn->bev = bev;
+        conn->underlying = underlying;
+        conn->kick = event_new(base, -1, 0, &UploadSpool::Kick, conn);
+        conn->queued = evbuffer_new();
+        conn->link = std::make_shared<Connection *>(conn);
+        // 暂停解析时底层读到这么多就停止读 socket
+        bufferevent_setwatermark(underlying, EV_READ, 0, kMaxQueued);
+        evbuffer_add_cb(bufferevent_get_output(bev), &UploadSpool::OnOutput,
+                        conn);
+        // 输出直接写 fd，允许文件段走 sendfile
+        evbuffer_set_flags(bufferevent_get_output(bev),
+                           EVBUFFER_FLAG_DRAINS_TO_FD);
+        return bev;
+    }
+
+    // 登记的落盘结果：error 为 0 时 session 是已落盘的上传，否则是要回复的状态码
+    struct Spooled {
+        bufferevent *owner = nullptr; // 所属连接的过滤 bufferevent
+        int error = 0;
+        SessionPtr session;
+    };
+
+    /**
+     * 取出 evcon 上的请求登记的落盘结果，每个 id 只能取一次
+     * @return id 不存在或者不属于 evcon 时返回 false
+     */
+    static bool Take(const std::string &id, evhttp_connection *evcon,
+                     Spooled *out) {
+        bufferevent *owner = evhttp_connection_get_bufferevent(evcon);
+        std::unique_lock<std::mutex> lock(Registry().mutex);
+        auto it = Registry().sessions.find(id);
+        if (it == Registry().sessions.end() || it->second.owner != owner)
+            return false;
+        *out = std::move(it->second);
+        Registry().sessions.erase(it);
+        return true;
+    }
+
+  private:
+    enum class State {
+        kHeader,  // 等待完整的请求头
+        kPass,    // 普通请求的请求体，原样交给 evhttp
+        kSpool,   // 上传的请求体，写进临时文件
+        kSkip,    // 出错的上传，丢弃请求体后继续处理下一个请求
+        kDiscard, // 超过上限的上传，丢弃之后所有数据，等待关闭连接
+        kRaw,     // 无法拆分的请求(chunked 或请求头过长)，之后全部原样转发
+        kFinish,  // 上传的请求体已收完，等待写盘完成，之后的数据暂不解析
+    };
+    static constexpr size_t kMaxHeader = 64 * 1024;
+    static constexpr size_t kMaxQueued = 4 * 1024 * 1024; // 每个上传的待写上限
+
+    // 每个连接的解析状态，随过滤 bufferevent 释放
+    struct Connection {
+        bufferevent *bev = nullptr;
+        bufferevent *underlying = nullptr;
+        event *kick = nullptr;     // 输出缓冲区有新数据时激活，见 OnOutput
+        event *writable = nullptr; // socket 写满时等待可写
+        bool interim = false;       // 正在写自己的 100 Continue
+        bool reply_pending = false; // 输出中有 evhttp 写入的数据
+        bool nodelay = false;       // socket 已设置 TCP_NODELAY
+        State state = State::kHeader;
+        uint64_t remaining = 0;
+        std::string held; // 扣下的改写后的请求头，不含结尾空行
+        SessionPtr session;
+        std::vector<std::string> registered; // 已登记但可能还没被取走的 id
+        evbuffer *queued = nullptr; // 已收到、还没交给线程池的请求体
+        bool writing = false;       // 线程池中有本连接的写盘任务
+        bool paused = false;        // 待写数据过多，输入留在底层缓冲区
+        // 写盘任务完成时凭它找到连接，连接释放后指向空
+        std::shared_ptr<Connection *> link;
+    };
+
+    struct SessionTable {
+        std::mutex mutex;
+        std::unordered_map<std::string, Spooled> sessions;
+        std::mt19937_64 rng{std::random_device{}()}; // 生成 id，由 mutex 保护
+    };
+    // 不析构：连接可能在静态析构阶段才释放
+    static SessionTable &Registry() {
+        static auto *table = new SessionTable;
+        return *table;
+    }
+
+    static void FreeConnection(void *ctx) {
+        auto *conn = static_cast<Connection *>(ctx);
+        // 连接断开时还没被处理函数取走的上传直接丢弃
+        Discard(conn->registered.begin(), conn->registered.end());
+        // 进行中的写盘任务持有 session，完成后发现连接已释放就丢弃上传
+        *conn->link = nullptr;
+        if (conn->queued != nullptr)
+            evbuffer_free(conn->queued);
+        if (conn->kick != nullptr)
+            event_free(conn->kick);
+        if (conn->writable != nullptr)
+            event_free(conn->writable);
+        delete conn;
+    }
+
+    /**
+     * 从登记表中删除 [first, last) 中还没被取走的上传
+     * session 析构时关闭 fd、删除临时文件，放到锁外进行
+     */
+    template <typename It>
+    static void Discard(It first, It last) {
+        std::vector<Spooled> dropped;
+        std::unique_lock<std::mutex> lock(Registry().mutex);
+        for (; first != last; ++first) {
+            auto it = Registry().sessions.find(*first);
+            if (it == Registry().sessions.end())
+                continue;
+            dropped.push_back(std::move(it->second));
+            Registry().sessions.erase(it);
+        }
+    }
+
+    /**
+     * evhttp 已经释放了连接，过滤 bufferevent 在等延迟析构
+     *
+     * bufferevent_free 先清空回调，真正析构(FreeConnection)要等到之后的
+     * 事件循环；这期间已激活的 kick 或写盘完成回调再碰它，引用计数会再次
+     * 归零，底层 bufferevent 被重复释放。
+     */
+    static bool Closed(Connection *conn) {
+        bufferevent_event_cb eventcb = nullptr;
+        bufferevent_getcb(conn->bev, nullptr, nullptr, &eventcb, nullptr);
+        return eventcb == nullptr;
+    }
+
+    /**
+     * 回复不经过过滤层，由这里直接写 socket
+     *
+     * 2.1 的过滤 bufferevent 有两个问题：evhttp 先写回复再打开 EV_WRITE，
+     * 打开时过滤层不会处理已积压的输出，回复会卡住；过滤层把数据交给底层
+     * bufferevent 就算写完，evhttp 随即关闭 Connection: close 的连接，
+     * 底层还没发出去的数据就丢了。所以输出过滤函数不搬运任何数据，回复留在
+     * 过滤层的输出缓冲区里，等 evhttp 这一轮处理完后在 Kick 中写进 socket，
+     * 全部写进内核后才通知 evhttp 写完成。
+     */
+    static bufferevent_filter_result Output(evbuffer *, evbuffer *, ev_ssize_t,
+                                            bufferevent_flush_mode, void *) {
+        return BEV_NEED_MORE;
+    }
+    static void OnOutput(evbuffer *, const evbuffer_cb_info *info, void *ctx) {
+        auto *conn = static_cast<Connection *>(ctx);
+        if (info->n_added == 0)
+            return;
+        if (!conn->interim)
+            conn->reply_pending = true;
+        event_active(conn->kick, 0, 0);
+    }
+    static void Kick(evutil_socket_t, short, void *ctx) {
+        auto *conn = static_cast<Connection *>(ctx);
+        if (Closed(conn))
+            return;
+        evbuffer *output = bufferevent_get_output(conn->bev);
+        const evutil_socket_t fd = bufferevent_getfd(conn->underlying);
+        // 回复头用 writev、正文用 sendfile 分两次写，开着 Nagle 时第二次
+        // 要等对端延迟确认，每个小回复都多出约 40ms
+        if (!conn->nodelay) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            conn->nodelay = true;
+        }
+        while (evbuffer_get_length(output) > 0) {
+            // 文件段由 evbuffer_write 用 sendfile 发送
+            const int n = evbuffer_write_atmost(output, fd, -1);
+            if (n > 0)
+                continue;
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (conn->writable == nullptr)
+                    conn->writable =
+                        event_new(bufferevent_get_base(conn->bev), fd,
+                                  EV_WRITE, &UploadSpool::Kick, conn);
+                event_add(conn->writable, nullptr);
+                return;
+            }
+            bufferevent_trigger_event(conn->bev,
+                                      BEV_EVENT_WRITING | BEV_EVENT_ERROR, 0);
+            return;
+        }
+        // 只写了 100 Continue 时不能通知 evhttp，否则它会当成上一个回复写完
+        if (conn->reply_pending) {
+            conn->reply_pending = false;
+            bufferevent_trigger(conn->bev, EV_WRITE, 0);
+        }
+    }
+
+    static bufferevent_filter_result Input(evbuffer *src, evbuffer *dst,
+                                           ev_ssize_t, bufferevent_flush_mode,
+                                           void *ctx) {
+        auto *conn = static_cast<Connection *>(ctx);
+        bool progress = false;
+        while (evbuffer_get_length(src) > 0) {
+            const size_t len = evbuffer_get_length(src);
+            const size_t n = static_cast<size_t>(
+                std::min<uint64_t>(conn->remaining, len));
+            switch (conn->state) {
+            case State::kRaw:
+                evbuffer_add_buffer(dst, src);
+                return BEV_OK;
+            case State::kDiscard:
+                evbuffer_drain(src, len);
+                return BEV_OK;
+            case State::kPass:
+                evbuffer_remove_buffer(src, dst, n);
+                if ((conn->remaining -= n) == 0)
+                    conn->state = State::kHeader;
+                break;
+            case State::kSpool:
+                if (evbuffer_get_length(conn->queued) >= kMaxQueued) {
+                    conn->paused = true;
+                    return progress ? BEV_OK : BEV_NEED_MORE;
+                }
+                evbuffer_remove_buffer(src, conn->queued, n);
+                if ((conn->remaining -= n) == 0)
+                    conn->state = State::kFinish;
+                Pump(conn);
+                break;
+            case State::kFinish:
+                conn->paused = true;
+                return progress ? BEV_OK : BEV_NEED_MORE;
+            case State::kSkip:
+                evbuffer_drain(src, n);
+                if ((conn->remaining -= n) == 0)
+                    conn->state = State::kHeader;
+                break;
+            case State::kHeader: {
+                const evbuffer_ptr end =
+                    evbuffer_search(src, "\r\n\r\n", 4, nullptr);
+                if (end.pos < 0) {
+                    if (len <= kMaxHeader)
+                        return progress ? BEV_OK : BEV_NEED_MORE;
+                    // 交给 evhttp 按它的规则拒绝
+                    conn->state = State::kRaw;
+                    continue;
+                }
+                std::string head(end.pos + 4, '\0');
+                evbuffer_remove(src, &head[0], head.size());
+                OnHeader(conn, head, dst);
+                break;
+            }
+            }
+            progress = true;
+        }
+        return BEV_OK;
+    }
+
+    static bool IEquals(const std::string &a, const char *b) {
+        return strcasecmp(a.c_str(), b) == 0;
+    }
+
+    /**
+     * 解析一个完整的请求头，决定该请求的请求体怎么处理
+     */
+    static void OnHeader(Connection *conn, const std::string &head,
+                         evbuffer *dst) {
+        size_t pos = head.find_first_not_of("\r\n");
+        size_t eol = head.find("\r\n", pos);
+        const std::string request_line = head.substr(pos, eol - pos);
+        const size_t sp1 = request_line.find(' ');
+        const size_t sp2 = request_line.find(' ', sp1 + 1);
+        const std::string method = request_line.substr(0, sp1);
+        std::string target = sp1 == std::string::npos
+                                 ? std::string()
+                                 : request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+        target = target.substr(0, target.find('?'));
+
+        int64_t content_length = -1;
+        bool chunked = false, expect_continue = false;
+        std::string filename, storage_type, rewritten = request_line + "\r\n";
+        // 原样转发时用的请求头，只去掉内部头
+        std::string filtered = rewritten;
+        for (pos = eol + 2; pos < head.size();) {
+            eol = head.find("\r\n", pos);
+            const std::string line = head.substr(pos, eol - pos);
+            pos = eol + 2;
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos)
+                continue;
+            const std::string key = line.substr(0, colon);
+            const size_t vstart = line.find_first_not_of(" \t", colon + 1);
+            const std::string value =
+                vstart == std::string::npos ? "" : line.substr(vstart);
+            // 不信任客户端带来的内部头，不管请求会不会被拆分都删掉
+            if (IEquals(key, "X-Upload-Spool"))
+                continue;
+            filtered += line + "\r\n";
+            if (IEquals(key, "Content-Length")) {
+                content_length = strtoll(value.c_str(), nullptr, 10);
+                continue;
+            }
+            if (IEquals(key, "Transfer-Encoding"))
+                chunked = value.find("chunked") != std::string::npos;
+            if (IEquals(key, "Expect")) {
+                expect_continue = strcasecmp(value.c_str(), "100-continue") == 0;
+                continue;
+            }
+            if (IEquals(key, "FileName"))
+                filename = value;
+            if (IEquals(key, "StorageType"))
+                storage_type = value;
+            rewritten += line + "\r\n";
+        }
+        filtered += "\r\n";
+
+        if (method != "POST" || target != "/upload" || chunked ||
+            content_length <= 0) {
+            evbuffer_add(dst, filtered.data(), filtered.size());
+            if (chunked) {
+                conn->state = State::kRaw;
+            } else if (content_length > 0) {
+                conn->state = State::kPass;
+                conn->remaining = content_length;
+            }
+            return;
+        }
+
+        conn->held = rewritten + "Content-Length: 0\r\n";
+        conn->remaining = content_length;
+        const uint64_t limit = Config::GetInstance()->GetMaxUploadBytes();
+        if (limit > 0 && static_cast<uint64_t>(content_length) > limit) {
+            Logger()->Warn("upload too large: %lld bytes",
+                           static_cast<long long>(content_length));
+            Release(conn, dst, Register(conn, 413, nullptr));
+            conn->state = State::kDiscard;
+            return;
+        }
+        std::string path;
+        if (!UploadSession::ResolvePath(filename, storage_type, &path)) {
+            Release(conn, dst, Register(conn, 400, nullptr));
+            conn->state = State::kSkip;
+            return;
+        }
+        conn->session.reset(new UploadSession(path, storage_type));
+        if (!conn->session->Open(content_length)) {
+            conn->session.reset();
+            Release(conn, dst, Register(conn, 500, nullptr));
+            conn->state = State::kSkip;
+            return;
+        }
+        // 请求头被扣下，evhttp 看不到 Expect，由这里回复 100 Continue
+        if (expect_continue) {
+            static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            conn->interim = true;
+            evbuffer_add(bufferevent_get_output(conn->bev), kContinue,
+                         sizeof(kContinue) - 1);
+            conn->interim = false;
+        }
+        conn->state = State::kSpool;
+    }
+
+    /**
+     * 把待写数据交给线程池写盘，同时只有一个写盘任务
+     * 请求体收完后最后一个任务还要写完压缩帧并关闭临时文件
+     */
+    static void Pump(Connection *conn) {
+        const bool finish = conn->state == State::kFinish;
+        if (conn->writing ||
+            (evbuffer_get_length(conn->queued) == 0 && !finish))
+            return;
+        conn->writing = true;
+        evbuffer *chunk = evbuffer_new();
+        evbuffer_add_buffer(chunk, conn->queued);
+        SessionPtr session = conn->session;
+        Offload::Bulk(
+            [session, chunk, finish]() {
+                session->Write(chunk, evbuffer_get_length(chunk));
+                evbuffer_free(chunk);
+                return !finish || session->Finish();
+            },
+            [link = conn->link, finish](bool ok) {
+                Connection *conn = *link;
+                if (conn == nullptr || Closed(conn))
+                    return;
+                conn->writing = false;
+                if (finish)
+                    FinishBody(conn, ok);
+                else
+                    Pump(conn);
+                Resume(conn);
+            });
+    }
+
+    // 暂停过的连接继续解析底层缓冲区里积压的数据
+    static void Resume(Connection *conn) {
+        if (!conn->paused || evbuffer_get_length(conn->queued) >= kMaxQueued)
+            return;
+        conn->paused = false;
+        // 重新调用过滤层的读回调，它会调用 Input，并在有进展时通知 evhttp
+        bufferevent_trigger(conn->underlying, EV_READ,
+                            BEV_TRIG_IGNORE_WATERMARKS);
+    }
+
+    // 请求体已全部写盘：登记落盘结果，放出扣下的请求头
+    static void FinishBody(Connection *conn, const bool ok) {
+        conn->state = State::kHeader;
+        // 不在过滤层的读回调里，放出的请求头要由 Resume 通知 evhttp
+        conn->paused = true;
+        SessionPtr session = std::move(conn->session);
+        evbuffer *dst = bufferevent_get_input(conn->bev);
+        if (!ok)
+            session.reset();
+        Release(conn, dst, Register(conn, ok ? 0 : 500, std::move(session)));
+    }
+
+    /**
+     * 登记落盘结果，返回要加进请求头的 X-Upload-Spool 行
+     * id 是 128 位随机数，猜不到别的连接的 id
+     */
+    static std::string Register(Connection *conn, const int error,
+                                SessionPtr session) {
+        char id[33];
+        {
+            std::unique_lock<std::mutex> lock(Registry().mutex);
+            do {
+                const uint64_t hi = Registry().rng(), lo = Registry().rng();
+                snprintf(id, sizeof(id), "%016llx%016llx",
+                         static_cast<unsigned long long>(hi),
+                         static_cast<unsigned long long>(lo));
+            } while (Registry().sessions.count(id) != 0);
+            Spooled &spooled = Registry().sessions[id];
+            spooled.owner = conn->bev;
+            spooled.error = error;
+            spooled.session = std::move(session);
+        }
+        conn->registered.push_back(id);
+        // 只记最近的 16 个 id，更早的还没被取走说明处理函数不会再来取
+        if (conn->registered.size() > 16) {
+            Discard(conn->registered.begin(), conn->registered.begin() + 1);
+            conn->registered.erase(conn->registered.begin());
+        }
+        return std::string("X-Upload-Spool: ") + id + "\r\n";
+    }
+
+    static void Release(Connection *conn, evbuffer *dst,
+                        const std::string &extra) {
+        conn->held += extra + "\r\n";
+        evbuffer_add(dst, conn->held.data(), conn->held.size());
+        conn->held.clear();
+    }
+};
+} // namespace storage
@@ -16,6 +16,19 @@
 namespace storage {
 namespace fs = std::filesystem;
 
+/**
+ * 服务端使用的 cloud_storage 日志器
+ *
+ * 每个请求会打十几条日志，用静态的缓存句柄只解析一次名字，
+ * 避免每条日志都去注册表查找并复制 shared_ptr
+ *
+ * @return 日志器指针，日志器尚未注册时为空
+ */
+inline mylog::AsyncLogger *Logger() {
+  static mylog::LoggerRef logger("cloud_storage");
+  return logger.get();
+}
+
 /**
  * 将数字转换为十六进制字符
  *
@@ -115,7 +128,7 @@ public:
     struct stat s;
     auto ret = stat(filename_.c_str(), &s);
     if (ret == -1) {
-      mylog::GetLogger("cloud_storage")
+      Logger()
           ->Info("%s, Get file size failed: %s", filename_.c_str(),
                  strerror(errno));
       return -1;
@@ -131,7 +144,7 @@ public:
     struct stat s;
     auto ret = stat(filename_.c_str(), &s);
     if (ret == -1) {
-      mylog::GetLogger("cloud_storage")
+      Logger()
           ->Info("%s, Get file access time failed: %s", filename_.c_str(),
                  strerror(errno));
       return -1;
@@ -148,7 +161,7 @@ public:
     struct stat s;
     auto ret = stat(filename_.c_str(), &s);
     if (ret == -1) {
-      mylog::GetLogger("cloud_storage")
+      Logger()
           ->Info("%s, Get file modify time failed: %s", filename_.c_str(),
                  strerror(errno));
       return -1;
@@ -179,8 +192,7 @@ public:
   bool GetPosLen(std::string *content, size_t pos, size_t len) {
     // 判断要求数据内容是否符合文件大小
     if (pos + len > FileSize()) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("needed data larger than file size");
+      Logger()->Info("needed data larger than file size");
       return false;
     }
 
@@ -188,8 +200,7 @@ public:
     std::ifstream ifs;
     ifs.open(filename_.c_str(), std::ios::binary);
     if (ifs.is_open() == false) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("%s,file open error", filename_.c_str());
+      Logger()->Info("%s,file open error", filename_.c_str());
       return false;
     }
 
@@ -198,8 +209,7 @@ public:
     content->resize(len);
     ifs.read(&(*content)[0], len);
     if (!ifs.good()) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("%s,read file content error", filename_.c_str());
+      Logger()->Info("%s,read file content error", filename_.c_str());
       ifs.close();
       return false;
     }
@@ -229,14 +239,12 @@ public:
     std::ofstream ofs;
     ofs.open(filename_.c_str(), std::ios::binary);
     if (!ofs.is_open()) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("%s open error: %s", filename_.c_str(), strerror(errno));
+      Logger()->Info("%s open error: %s", filename_.c_str(), strerror(errno));
       return false;
     }
     ofs.write(content, len);
     if (!ofs.good()) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("%s, file set content error", filename_.c_str());
+      Logger()->Info("%s, file set content error", filename_.c_str());
       ofs.close();
     }
     ofs.close();
@@ -248,22 +256,29 @@ public:
   //  压缩文件
   /**
    * @description: 压缩文件
+   * 流式压缩，压缩结果按块直接写入文件，不再额外分配 compressBound 大小的缓冲区
    * @param {const std::string &} content
+   * @param {int} level 压缩级别
+   * @param {int} workers zstd 压缩线程数，0 表示在调用线程中压缩
+   * @param {size_t} frame_size 每帧的原始大小，大于 0 时写成 seekable 格式
    * @return {bool} 是否成功
    */
-  bool Compress(const std::string &content) {
-
-    std::string packed = zstd_wrapper::pack(content);
-    if (packed.size() == 0) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("Compress packed size error:%d", packed.size());
+  bool Compress(const std::string &content, int level = 3, int workers = 0,
+                size_t frame_size = 0) {
+    std::ofstream ofs(filename_, std::ios::binary);
+    if (!ofs.is_open()) {
+      Logger()->Info("%s open error: %s", filename_.c_str(), strerror(errno));
       return false;
     }
-    // 将压缩的数据写入压缩包文件中
-    FileUtil f(filename_);
-    if (f.SetContent(packed.c_str(), packed.size()) == false) {
-      mylog::GetLogger("cloud_storage")
-          ->Info("filename:%s, Compress SetContent error", filename_.c_str());
+    zstd_wrapper::StreamPacker packer(level, workers, content.size(),
+                                      frame_size);
+    auto sink = [&ofs](const char *data, size_t len) {
+      ofs.write(data, len);
+      return ofs.good();
+    };
+    if (!packer.Update(content.data(), content.size(), sink) ||
+        !packer.End(sink)) {
+      Logger()->Info("filename:%s, Compress error", filename_.c_str());
       return false;
     }
     return true;
@@ -277,7 +292,7 @@ public:
     // 将当前压缩包数据读取出来
     std::string body;
     if (this->GetContent(&body) == false) {
-      mylog::GetLogger("cloud_storage")
+      Logger()
           ->Info("filename:%s, uncompress get file content failed!",
                  filename_.c_str());
       return false;
@@ -287,7 +302,7 @@ public:
     // 将解压缩的数据写入到新文件
     FileUtil fu(download_path);
     if (fu.SetContent(unpacked.c_str(), unpacked.size()) == false) {
-      mylog::GetLogger("cloud_storage")
+      Logger()
           ->Info("filename:%s, uncompress write packed data failed!",
                  filename_.c_str());
       return false;
@@ -323,7 +338,7 @@ public:
     std::unique_ptr<Json::StreamWriter> usw(swb.newStreamWriter());
     std::stringstream ss;
     if (usw->write(val, &ss) != 0) {
-      mylog::GetLogger("cloud_storage")->Info("serialize error");
+      Logger()->Info("serialize error");
       return false;
     }
     *str = ss.str();
@@ -341,10 +356,10 @@ public:
     std::unique_ptr<Json::CharReader> ucr(crb.newCharReader());
     std::string err;
     if (ucr->parse(str.c_str(), str.c_str() + str.size(), val, &err) == false) {
-      mylog::GetLogger("cloud_storage")->Info("parse error");
+      Logger()->Info("parse error");
       return false;
     }
-    return false;
+    return true;
   }
 };
 } // namespace storage
\ No newline at end of file
@@ -1,6 +1,7 @@
 
 #define DEBUG_LOG
 #include "Service.hpp"
+#include <cstring>
 #include <thread>
 using namespace std;
 
@@ -9,12 +10,16 @@ ThreadPool *tp = nullptr;
 
 void service_module() {
   storage::Service s;
-  mylog::GetLogger("cloud_storage")->Info("service step in RunModule");
+  storage::Logger()->Info("service step in RunModule");
   s.RunModule();
 }
 
 void log_system_module_init() {
   tp = new ThreadPool(mylog::util::LogConfig::GetJsonData()->thread_count);
+  for (const auto &tc : mylog::util::LogConfig::GetJsonData()->thread_classes)
+    tp->addClass(tc.name, tc.priority, tc.max_concurrency, tc.max_queue);
+  tp->setCpuAffinity(mylog::util::Affinity::ParseCpuList(
+      mylog::util::LogConfig::GetJsonData()->pool_cpus));
   std::shared_ptr<mylog::LoggerBuilder> Glb(new mylog::LoggerBuilder());
   Glb->BuildName("cloud_storage");
   Glb->BuildLoggerFlush<mylog::RollFileFlush>("../log_system/logfile/RollFile_log",
@@ -22,13 +27,36 @@ void log_system_module_init() {
 
   mylog::LoggerManager::GetInstance().AddLogger(Glb->Build());
 }
-int main() {
+// --export-metadata <file> / --import-metadata <file>：把元数据导出成 JSON
+// 或从 JSON 导入并写成快照，不启动服务
+int metadata_tool(const char *op, const char *file) {
+  bool ok = false;
+  if (strcmp(op, "--export-metadata") == 0) {
+    ok = data_->ExportJson(file);
+  } else if (strcmp(op, "--import-metadata") == 0) {
+    ok = data_->ImportJson(file) && data_->Storage();
+  } else {
+    fprintf(stderr, "usage: server [--export-metadata|--import-metadata <file>]\n");
+    return 2;
+  }
+  fprintf(stderr, "%s %s: %s\n", op + 2, file, ok ? "ok" : "failed");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
   log_system_module_init();
   data_ = new storage::DataManager();
+  if (argc > 1) {
+    int rc = metadata_tool(argv[1], argc == 3 ? argv[2] : "");
+    mylog::LoggerManager::GetInstance().FlushAll(std::chrono::seconds(5));
+    return rc;
+  }
 
   thread t1(service_module);
 
   t1.join();
+  // 退出前确保已写入的日志全部落盘
+  mylog::LoggerManager::GetInstance().FlushAll(std::chrono::seconds(5));
   delete (tp);
   return 0;
 }
\ No newline at end of file
@@ -3,35 +3,15 @@
 #include <zstd.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <functional>
+#include <unistd.h>
 
 namespace zstd_wrapper {
 
 
-static std::string pack(const std::string& content, int compression_level = 3) {
-    
-    if (content.empty()) {
-        return content;
-    }
-    
-    size_t const compressed_size = ZSTD_compressBound(content.size());
-    std::string compressed;
-    compressed.resize(compressed_size);
-    
-    size_t const actual_size = ZSTD_compress(
-        &compressed[0], compressed_size,
-        content.data(), content.size(),
-        compression_level
-    );
-    
-    if (ZSTD_isError(actual_size)) {
-        return "";
-    }
-    
-    compressed.resize(actual_size);
-    return compressed;
-}
-
 static std::string unpack(const std::string& content) {
     if (content.empty()) {
         return content;
@@ -80,4 +60,217 @@ static std::string unpack(const std::string& content) {
 
 
 
+/**
+ * 流式压缩：边输入边输出 zstd 帧，内存占用与输入总长度无关
+ *
+ * 压缩结果按固定大小的块交给 sink，sink 返回 false 表示写出失败。
+ * workers > 0 时使用 zstd 的多线程压缩；libzstd 没有编译多线程支持时
+ * 设置会失败，此时退回单线程压缩。
+ *
+ * frame_size 为 0 时输出单个帧；大于 0 时每 frame_size 字节输入结束一个
+ * 独立的帧，最后追加跳转表，即 zstd 的 seekable 格式(contrib/seekable_format)：
+ *   [帧0][帧1]...[帧N-1][可跳过帧: 每帧的压缩大小和原始大小 + 尾部]
+ * 尾部为帧数(u32)、描述符(u8)、魔数 0x8F92EAB1(u32)，全部小端。
+ * 普通的 zstd 解压器会跳过跳转表，把结果当成多个帧的拼接正常解压。
+ */
+class StreamPacker {
+public:
+    using Sink = std::function<bool(const char *, size_t)>;
+    static constexpr uint32_t kSkippableMagic = 0x184D2A5E;
+    static constexpr uint32_t kSeekableMagic = 0x8F92EAB1;
+    static constexpr size_t kFooterSize = 9;
+
+    StreamPacker(int compression_level = 3, int workers = 0,
+                 unsigned long long pledged_size = ZSTD_CONTENTSIZE_UNKNOWN,
+                 size_t frame_size = 0)
+        : cctx_(ZSTD_createCCtx()), out_(ZSTD_CStreamOutSize()),
+          pledged_(pledged_size), frame_size_(frame_size) {
+        if (cctx_ == nullptr)
+            return;
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel,
+                               compression_level);
+        if (workers > 0)
+            ZSTD_CCtx_setParameter(cctx_, ZSTD_c_nbWorkers, workers);
+        Pledge();
+    }
+    ~StreamPacker() { ZSTD_freeCCtx(cctx_); }
+    StreamPacker(const StreamPacker &) = delete;
+    StreamPacker &operator=(const StreamPacker &) = delete;
+
+    // 压缩一段输入
+    bool Update(const void *data, size_t len, const Sink &sink) {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0) {
+            size_t n = len;
+            if (frame_size_ > 0)
+                n = std::min(n, frame_size_ - frame_in_);
+            ZSTD_inBuffer in = {p, n, 0};
+            if (!Run(&in, ZSTD_e_continue, sink))
+                return false;
+            frame_in_ += n;
+            p += n;
+            len -= n;
+            if (frame_size_ > 0 && frame_in_ == frame_size_ && !EndFrame(sink))
+                return false;
+        }
+        return true;
+    }
+    // 输入结束，写出最后一帧的剩余部分，seekable 格式还要写出跳转表
+    bool End(const Sink &sink) {
+        // seekable 格式的空输入不产生帧，只有跳转表
+        if ((frame_size_ == 0 || frame_in_ > 0) && !EndFrame(sink))
+            return false;
+        return frame_size_ == 0 || WriteSeekTable(sink);
+    }
+
+private:
+    struct Entry {
+        uint32_t compressed;
+        uint32_t decompressed;
+    };
+
+    // 预先知道长度时写进帧头，解压端可以据此得到原始大小
+    void Pledge() {
+        if (pledged_ == ZSTD_CONTENTSIZE_UNKNOWN)
+            return;
+        unsigned long long size = pledged_ - consumed_;
+        if (frame_size_ > 0)
+            size = std::min<unsigned long long>(size, frame_size_);
+        ZSTD_CCtx_setPledgedSrcSize(cctx_, size);
+    }
+
+    bool EndFrame(const Sink &sink) {
+        ZSTD_inBuffer in = {nullptr, 0, 0};
+        if (!Run(&in, ZSTD_e_end, sink))
+            return false;
+        frames_.push_back({static_cast<uint32_t>(frame_out_),
+                           static_cast<uint32_t>(frame_in_)});
+        consumed_ += frame_in_;
+        frame_in_ = 0;
+        frame_out_ = 0;
+        Pledge();
+        return true;
+    }
+
+    bool WriteSeekTable(const Sink &sink) {
+        std::string table;
+        PutU32(&table, kSkippableMagic);
+        PutU32(&table, static_cast<uint32_t>(frames_.size() * 8 + kFooterSize));
+        for (const Entry &e : frames_) {
+            PutU32(&table, e.compressed);
+            PutU32(&table, e.decompressed);
+        }
+        PutU32(&table, static_cast<uint32_t>(frames_.size()));
+        table.push_back('\0'); // 描述符：不带校验和
+        PutU32(&table, kSeekableMagic);
+        return sink(table.data(), table.size());
+    }
+
+    static void PutU32(std::string *out, uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+
+    bool Run(ZSTD_inBuffer *in, ZSTD_EndDirective mode, const Sink &sink) {
+        if (cctx_ == nullptr)
+            return false;
+        for (;;) {
+            ZSTD_outBuffer out = {&out_[0], out_.size(), 0};
+            const size_t remaining =
+                ZSTD_compressStream2(cctx_, &out, in, mode);
+            if (ZSTD_isError(remaining))
+                return false;
+            if (out.pos > 0 && !sink(&out_[0], out.pos))
+                return false;
+            frame_out_ += out.pos;
+            // continue 模式输入用完即可；end 模式要等帧完全写出
+            if (mode == ZSTD_e_end ? remaining == 0 : in->pos == in->size)
+                return true;
+        }
+    }
+
+    ZSTD_CCtx *cctx_;
+    std::vector<char> out_;
+    unsigned long long pledged_;
+    size_t frame_size_;
+    size_t frame_in_ = 0;             // 当前帧已输入的原始字节数
+    size_t frame_out_ = 0;            // 当前帧已输出的压缩字节数
+    unsigned long long consumed_ = 0; // 已结束的帧的原始字节总数
+    std::vector<Entry> frames_;
+};
+
+/**
+ * seekable 格式的跳转表，用来把原始偏移换算成压缩文件中的帧位置
+ */
+class SeekTable {
+public:
+    struct Frame {
+        uint64_t compressed_offset;   // 帧在压缩文件中的起始位置
+        uint64_t decompressed_offset; // 帧的第一个字节在原始数据中的位置
+    };
+
+    /**
+     * 从文件末尾读取跳转表
+     * @return 不是 seekable 格式(例如旧的单帧文件)时返回 false
+     */
+    bool Load(int fd, uint64_t file_size) {
+        const size_t footer = StreamPacker::kFooterSize;
+        if (file_size < 8 + footer)
+            return false;
+        unsigned char tail[StreamPacker::kFooterSize];
+        if (pread(fd, tail, footer, file_size - footer) !=
+            static_cast<ssize_t>(footer))
+            return false;
+        if (GetU32(tail + 5) != StreamPacker::kSeekableMagic)
+            return false;
+        const uint32_t count = GetU32(tail);
+        const bool checksum = (tail[4] & 0x80) != 0;
+        const size_t entry = checksum ? 12 : 8;
+        const uint64_t table_size = 8 + uint64_t(count) * entry + footer;
+        if (table_size > file_size)
+            return false;
+        std::vector<unsigned char> table(table_size);
+        if (pread(fd, table.data(), table.size(), file_size - table_size) !=
+            static_cast<ssize_t>(table.size()))
+            return false;
+        if (GetU32(table.data()) != StreamPacker::kSkippableMagic)
+            return false;
+        frames_.clear();
+        frames_.reserve(count);
+        uint64_t c = 0, d = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            const unsigned char *e = table.data() + 8 + i * entry;
+            frames_.push_back({c, d});
+            c += GetU32(e);
+            d += GetU32(e + 4);
+        }
+        compressed_size_ = c;
+        size_ = d;
+        return c + table_size == file_size;
+    }
+
+    // 原始数据的总长度
+    uint64_t Size() const { return size_; }
+
+    // 包含原始偏移 pos 的帧，pos 超出范围时返回最后一帧之后的位置
+    Frame Locate(uint64_t pos) const {
+        auto it = std::upper_bound(
+            frames_.begin(), frames_.end(), pos,
+            [](uint64_t p, const Frame &f) { return p < f.decompressed_offset; });
+        if (it == frames_.begin())
+            return {compressed_size_, size_};
+        return *(it - 1);
+    }
+
+private:
+    static uint32_t GetU32(const unsigned char *p) {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+               uint32_t(p[3]) << 24;
+    }
+
+    std::vector<Frame> frames_;
+    uint64_t compressed_size_ = 0;
+    uint64_t size_ = 0;
+};
+
 } // namespace zstd_wrapper
\ No newline at end of file